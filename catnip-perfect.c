@@ -0,0 +1,72 @@
+/*
+ * catnip-perfect writes catnip-hash.h: for each word list in catnip-words.h
+ * it finds a table size and seed for catnip_hash() that put every word in a
+ * slot of its own, and emits the slot tables catnip.c looks words up in.
+ *
+ *	cc -o catnip-perfect catnip-perfect.c && ./catnip-perfect > catnip-hash.h
+ *
+ * MIT License, Copyright (c) 2022 Brad Werner; see catnip.c for the full text.
+ */
+
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "catnip-words.h"
+
+#define CATNIP_WORD(name, ...) name,
+static const char* methods[] = { CATNIP_METHODS( CATNIP_WORD ) NULL };
+static const char* versions[] = { CATNIP_VERSIONS( CATNIP_WORD ) NULL };
+static const char* headers[] = { CATNIP_HEADERS( CATNIP_WORD ) NULL };
+#undef CATNIP_WORD
+
+#define MAX_SLOTS 4096
+#define MAX_SEEDS 1000000
+
+static void
+perfect( const char* prefix, const char* name, const char** words, int fold )
+{
+	int n, bits, slots[MAX_SLOTS];
+	unsigned seed;
+
+	for( n = 0; words[n] != NULL; ++n )
+		;
+	for( bits = 1; ( 1 << bits ) < n; ++bits )
+		;
+	for( ; ( 1 << bits ) <= MAX_SLOTS; ++bits ){
+		unsigned mask = ( 1u << bits ) - 1;
+		for( seed = 0; seed < MAX_SEEDS; ++seed ){
+			int i;
+			memset( slots, -1, sizeof( slots ) );
+			for( i = 0; i < n; ++i ){
+				unsigned slot = catnip_hash( words[i], strlen( words[i] ), seed, fold ) & mask;
+				if( slots[slot] >= 0 )
+					break; // collision, next seed
+				slots[slot] = i;
+			}
+			if( i < n )
+				continue;
+			printf( "\n// %d words in %d slots\n", n, 1 << bits );
+			printf( "#define CATNIP_%s_SEED %uu\n", prefix, seed );
+			printf( "#define CATNIP_%s_SLOTS %d\n", prefix, 1 << bits );
+			printf( "static const signed char catnip_%s_slot[CATNIP_%s_SLOTS] = {", name, prefix );
+			for( i = 0; i < ( 1 << bits ); ++i )
+				printf( "%s%s%d", i ? "," : "", i % 16 ? " " : "\n\t", slots[i] );
+			printf( "\n};\n" );
+			return;
+		}
+	}
+	errx( 1, "no perfect hash for the %s list", prefix );
+}
+
+int
+main( void )
+{
+	printf( "/* generated by catnip-perfect from catnip-words.h: do not edit */\n" );
+	printf( "/* slot -> index into the list (http_methods[], http_versions[], enum http_header), -1 empty */\n" );
+	perfect( "METHOD", "method", methods, 0 );
+	perfect( "VERSION", "version", versions, 0 );
+	perfect( "HEADER", "header", headers, 1 );
+	return 0;
+}
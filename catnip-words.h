@@ -0,0 +1,97 @@
+/*
+ * the words catnip looks up while parsing: methods, versions and the request
+ * headers it knows by name. catnip-perfect turns these lists into the
+ * collision-free tables of catnip-hash.h at build time, so each lookup in
+ * catnip.c is one catnip_hash() and one compare.
+ *
+ * add to a list here and rebuild; catnip-hash.h follows along.
+ */
+
+// method name, action (see http_methods[] in catnip.c)
+#define CATNIP_METHODS(X) \
+	X( "TRACE",	http_trace ) \
+	X( "HEAD",	http_head ) \
+	X( "GET",	http_get ) \
+	X( "POST",	http_post ) \
+	X( "PATCH",	http_patch ) \
+	X( "PUT",	http_put ) \
+	X( "OPTIONS",	http_options ) \
+	X( "DELETE",	http_delete ) \
+	X( "CONNECT",	http_connect )
+
+// version string, enum http_version, persistent by default (see http_versions[] in catnip.c)
+#define CATNIP_VERSIONS(X) \
+	X( "HTTP/1.0",	HTTP_1_0, 0 ) \
+	X( "HTTP/1.1",	HTTP_1_1, 1 ) \
+	X( "HTTP/2.0",	HTTP_2_0, 1 )
+
+// status code, reason phrase; not hashed, these make the precomputed status
+// lines of status_line() in catnip.c
+#define CATNIP_STATUSES(X) \
+	X( 200,	"OK" ) \
+	X( 206,	"Partial Content" ) \
+	X( 304,	"Not Modified" ) \
+	X( 400,	"Bad Request" ) \
+	X( 403,	"Forbidden" ) \
+	X( 404,	"Not Found" ) \
+	X( 412,	"Precondition Failed" ) \
+	X( 413,	"Payload Too Large" ) \
+	X( 416,	"Range Not Satisfiable" ) \
+	X( 431,	"Request Header Fields Too Large" ) \
+	X( 500,	"Internal Server Error" ) \
+	X( 501,	"Not Implemented" ) \
+	X( 505,	"HTTP Version Not Supported" )
+
+// header name (matched case-insensitively), enum http_header
+#define CATNIP_HEADERS(X) \
+	X( "Host",			HEADER_HOST ) \
+	X( "Connection",		HEADER_CONNECTION ) \
+	X( "Content-Length",		HEADER_CONTENT_LENGTH ) \
+	X( "Content-Type",		HEADER_CONTENT_TYPE ) \
+	X( "Transfer-Encoding",		HEADER_TRANSFER_ENCODING ) \
+	X( "TE",			HEADER_TE ) \
+	X( "Expect",			HEADER_EXPECT ) \
+	X( "Upgrade",			HEADER_UPGRADE ) \
+	X( "Keep-Alive",		HEADER_KEEP_ALIVE ) \
+	X( "User-Agent",		HEADER_USER_AGENT ) \
+	X( "Accept",			HEADER_ACCEPT ) \
+	X( "Accept-Encoding",		HEADER_ACCEPT_ENCODING ) \
+	X( "Accept-Language",		HEADER_ACCEPT_LANGUAGE ) \
+	X( "Accept-Charset",		HEADER_ACCEPT_CHARSET ) \
+	X( "Cookie",			HEADER_COOKIE ) \
+	X( "Authorization",		HEADER_AUTHORIZATION ) \
+	X( "Cache-Control",		HEADER_CACHE_CONTROL ) \
+	X( "Pragma",			HEADER_PRAGMA ) \
+	X( "Range",			HEADER_RANGE ) \
+	X( "If-Range",			HEADER_IF_RANGE ) \
+	X( "If-Match",			HEADER_IF_MATCH ) \
+	X( "If-None-Match",		HEADER_IF_NONE_MATCH ) \
+	X( "If-Modified-Since",		HEADER_IF_MODIFIED_SINCE ) \
+	X( "If-Unmodified-Since",	HEADER_IF_UNMODIFIED_SINCE ) \
+	X( "Referer",			HEADER_REFERER ) \
+	X( "Origin",			HEADER_ORIGIN ) \
+	X( "Via",			HEADER_VIA ) \
+	X( "Forwarded",			HEADER_FORWARDED ) \
+	X( "X-Forwarded-For",		HEADER_X_FORWARDED_FOR ) \
+	X( "DNT",			HEADER_DNT )
+
+#define CATNIP_HEADER_ID(name, id) id,
+enum http_header {
+	CATNIP_HEADERS( CATNIP_HEADER_ID )
+	HEADER_COUNT,
+	HEADER_UNKNOWN = HEADER_COUNT
+};
+#undef CATNIP_HEADER_ID
+
+/*
+ * FNV-1a over the bytes (ASCII case folded when fold is set), salted with
+ * a seed catnip-perfect picks so that every word of a list gets its own slot.
+ */
+static inline unsigned
+catnip_hash( const char* s, size_t len, unsigned seed, int fold )
+{
+	unsigned h = 2166136261u ^ seed ^ (unsigned)len;
+	for( size_t i = 0; i < len; ++i )
+		h = ( h ^ (unsigned char)( fold ? s[i] | 0x20 : s[i] ) ) * 16777619u;
+	return h ^ ( h >> 16 );
+}
@@ -82,6 +82,10 @@ static const char rcsid2[] =
   "$FreeBSD: src/bin/cat/cat.c,v 1.32 2005/01/10 08:39:20 imp Exp $";
 #endif /* not lint */
 
+#ifdef __linux__
+#define _GNU_SOURCE	// copy_file_range for the kernel-side raw_cat
+#endif
+
 #include <ctype.h>
 #include <err.h>
 #include <errno.h>
@@ -93,52 +97,187 @@ static const char rcsid2[] =
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdarg.h>	// buffer_printf
+#include <stdint.h>
+#include <pthread.h>	// the listener's handler pool
+#include <zlib.h>	// -z, gzip on the fly
+#ifdef __linux__
+#include <sys/ioctl.h>	// FICLONE reflink
+#include <sys/sendfile.h>
+#include <linux/fs.h>
+#include <sys/epoll.h>	// cn -l listener
+#include <sys/inotify.h>	// meta cache invalidation
+#include <sys/eventfd.h>	// pool jobs coming back
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>	// makedev for statx
+#include <poll.h>
+#include <linux/io_uring.h>	// -E uring, raw system calls and all
+#include <sys/mman.h>	// kitty ring
+#include <sys/wait.h>	// -p pipelines
+#include <sys/prctl.h>
+#include <sched.h>	// -A pinning
+#include <limits.h>	// PATH_MAX
+#include <sys/socket.h>
+#include <netdb.h>
+#endif
 
+#include "catnip-words.h"	// method, version and header lists
+#include "catnip-hash.h"	// their perfect hash slots, generated by catnip-perfect
 #include "catnip.h"	// for http_parse_state and http_request
+#include "kitty-ring.h"	// the rendezvous kc shares with us
 
 int main(int, char *[]);
+void reset_http_request( struct http_request* req );
 void nosig(char *);
 int signame_to_signum(char *);
 void usage(void);
 static pid_t read_kitty_marker();
+static int nip_kitty( char* kitty, pid_t* pid, int numsig, char* name, int fd );
 static void parse_request(int, int, int, char*, int);
-void reset_response_headers();
-void add_response_header( char* key, char* value );
-void write_response_headers( int head_fd );
-static void write_http_response( int head_fd, char* version, int status, char* message, char* content_type, char** other_headers );
+static enum http_parse_result parse_http_request( struct http_request* req );
+static int grow_http_request( struct http_request* req, size_t want );
+static size_t parse_size( char* arg );
+static void process_request_header( struct http_request* req );
+static struct method_action* lookup_method( char* s, size_t len );
+static struct version_map* lookup_version( char* s, size_t len );
+static enum http_header lookup_header( char* s, size_t len );
+static int header_has_token( char* value, char* token );
+static void next_http_request( struct http_request* req );
+static void dispatch_request( struct http_request* req );
+void reset_response_headers( struct http_request* req );
+void add_response_header( struct http_request* req, char* key, char* value );
+char* find_response_header( struct http_request* req, char* key );
+void set_response_header( struct http_request* req, char* key, char* value );
+void drop_response_header( struct http_request* req, char* key );
+void write_response_headers( struct catnip_buffer* head, struct http_request* req );
+static void write_http_response( struct catnip_buffer* head, struct http_request* req );
+static void* catnip_malloc( size_t size );
+static void* catnip_calloc( size_t n, size_t size );
+static void* catnip_realloc( void* p, size_t size );
+static void* arena_alloc( struct catnip_arena* a, size_t size );
+static char* arena_strdup( struct catnip_arena* a, char* s );
+static void arena_reset( struct catnip_arena* a );
+static void print_stats( FILE* fp );
+static struct catnip_meta* meta_lookup( char* path );
+static void release_doc( int fd, struct catnip_meta* meta );
+static char* meta_content( struct catnip_meta* meta );
+static int write_http_body( int body_fd, struct http_request* req );
+static void buffer_reserve( struct catnip_buffer* b, size_t more );
+static void buffer_append( struct catnip_buffer* b, const void* data, size_t len );
+static void buffer_printf( struct catnip_buffer* b, const char* fmt, ... );
+static void buffer_puts( struct catnip_buffer* b, const char* s );
+static void buffer_chunk( struct catnip_buffer* b, const void* data, size_t len );
+static int echo_http_body( int rfd, int body_fd, struct http_request* req );
+static const char* status_line( struct http_request* req, size_t* len );
+static const char* date_line( size_t* len );
+static int buffer_flush( int fd, struct catnip_buffer* b );
+static int raw_cat( char* filename, int rfd, int wfd );
+static int raw_cat_kernel( char* filename, int rfd, int wfd );
+static int range_cat( char* filename, int rfd, int wfd, off_t offset, off_t length );
+static int range_part( struct http_request* req, int i, char* buf, size_t size );
+static struct catnip_zvar* zcache_find( char* path, struct timespec* mtime, const char* encoding );
+static void zcache_release( struct catnip_zvar* z );
+static struct catnip_gzip* gzip_start( int fd, const char* data, off_t length, char* key );
+static int gzip_next( struct catnip_gzip* g );
+static void gzip_free( struct catnip_gzip* g );
+static int serve_http( char* port, char* webroot, int usefork );
+static int supervise_pipelines( char* port, int n, char* kc, char* webroot, int usefork );
+static int prefork_workers( char* port, int n, int pin, char* webroot, int usefork );
 
 // prior version of action methods took ( int body_fd, char* request_body, int length )
-int http_trace( int body_fd, struct http_request* req );
-int http_head( int body_fd, struct http_request* req );
-int http_get( int body_fd, struct http_request* req );
-int http_post( int body_fd, struct http_request* req );
-int http_patch( int body_fd, struct http_request* req );
-int http_put( int body_fd, struct http_request* req );
-int http_options( int body_fd, struct http_request* req );
-int http_delete( int body_fd, struct http_request* req );
-int http_connect( int body_fd, struct http_request* req );
+// and then ( int body_fd, struct http_request* req ); actions now stage their body in req
+int http_trace( struct http_request* req );
+int http_head( struct http_request* req );
+int http_get( struct http_request* req );
+int http_post( struct http_request* req );
+int http_patch( struct http_request* req );
+int http_put( struct http_request* req );
+int http_options( struct http_request* req );
+int http_delete( struct http_request* req );
+int http_connect( struct http_request* req );
+static int http_range( struct http_request* req );
+static int http_conditional( struct http_request* req, char* etag, time_t mtime );
+static int http_encoding( struct http_request* req, unsigned have );
+static char* http_gzip( struct http_request* req, char* path, struct stat* st, char* etag );
+static int encoding_accepted( char* value, char* token );
+static int sibling_fresh( struct stat* doc, struct stat* sib );
+static void doc_etag( char* etag, size_t size, struct stat* st, int fd );
 
+// the lists themselves live in catnip-words.h, shared with catnip-perfect
+#define METHOD_ACTION(method, action) { method, action },
 struct method_action http_methods[] = {
-	{ "TRACE",	http_trace },
-	{ "HEAD",  	http_head },
-	{ "GET",   	http_get }, 
-	{ "POST",  	http_post }, 
-	{ "PATCH", 	http_patch },
-	{ "PUT", 	http_put },
-	{ "OPTIONS", 	http_options },
-	{ "DELETE", 	http_delete },
-	{ "CONNECT", 	http_connect },
+	CATNIP_METHODS( METHOD_ACTION )
 	{ NULL,		0 }
 };
+#undef METHOD_ACTION
 
+#define VERSION_MAP(version, http_version, keep_alive) { version, http_version, keep_alive },
 struct version_map http_versions[] = { // plural
-	{ "HTTP/1.0", HTTP_1_0 },
-	{ "HTTP/1.1", HTTP_1_1 },
-	{ "HTTP/2.0", HTTP_2_0 },
-	{ NULL, HTTP_VERSION_UNKNOWN }
+	CATNIP_VERSIONS( VERSION_MAP )
+	{ NULL, HTTP_VERSION_UNKNOWN, 0 }
+};
+#undef VERSION_MAP
+
+#define HEADER_NAME(name, id) name,
+char* http_headers[] = {
+	CATNIP_HEADERS( HEADER_NAME )
+	NULL
 };
+#undef HEADER_NAME
 
 int  verbosity; // debugging detail, global is as global does
+struct catnip_stats stats; // see print_stats()
+size_t header_limit = 32 * 1024;	// -H: most a request head may take, else 431
+off_t  body_limit = 1024 * 1024;	// -B: most a request body may take, else 413; an HTTP/1.1 TRACE streams, see conn_echo()
+size_t content_budget = 32 * 1024 * 1024;	// -C: most document bytes the listener keeps in memory
+size_t content_max = 1024 * 1024;	// -M: biggest document it keeps
+int    pool_threads = 4;	// -T: listener threads for handlers that would block, 0 for none
+char*  backend = "auto";	// -E: listener I/O, epoll, uring, or auto for io_uring where the kernel has it
+int    etag_hash;	// -e: ETags hash the content, not the inode, size and mtime
+int    gzip_level;	// -z: gzip documents on the fly at this level, 0 for not at all
+size_t zcache_budget = 8 * 1024 * 1024;	// -Z: most bytes of gzipped bodies kept for next time
+
+#define CATNIP_GZIP_MIN 1024 // below this a document goes as it is, a packet is a packet
+// what -z gzips, by suffix; images, fonts and archives are compressed already
+static char* gzip_types[] = { ".html", ".htm", ".css", ".js", ".mjs", ".json", ".svg", ".txt", ".xml", ".wasm", NULL };
+
+// precompressed siblings (make precompress) http_encoding() may send instead, best first
+static struct catnip_encoding {
+	char*	token; // Accept-Encoding and Content-Encoding
+	char*	suffix; // index.html.gz next to index.html
+} catnip_encodings[CATNIP_ENCODINGS + 1] = {
+	{ "br",		".br" },
+	{ "zstd",	".zst" },
+	{ "gzip",	".gz" },
+	{ NULL,		NULL }
+};
+
+/*
+ * a document being gzipped as it goes out (-z), a chunk of chunked framing
+ * at a time: gzip_next() deflates until it has CATNIP_GZIP_CHUNK bytes to
+ * send (or the end), and frames them. the listener sends each chunk as the
+ * socket takes it, so memory stays bounded whatever the size; what has
+ * gone out is kept alongside for the variant cache, up to -M.
+ */
+#define CATNIP_GZIP_CHUNK 16384
+#define CATNIP_CHUNK_HEAD 8 // room for the size line in front of a chunk
+#define CATNIP_LAST_CHUNK "0\r\n\r\n" // ends a chunked body, no trailers
+
+struct catnip_gzip {
+	z_stream z;
+	int	fd; // the document, read from offset on
+	const char* data; // or the document in memory
+	off_t	offset;
+	off_t	remaining; // still to deflate
+	int	finished;
+	char*	chunk; // framed and ready, within out
+	size_t	chunk_len;
+	char*	key; // the variant cache's, NULL once the body outgrows -M
+	struct timespec mtime;
+	struct catnip_buffer keep; // the body so far, for zcache_insert()
+	char	in[4 * CATNIP_GZIP_CHUNK];
+	char	out[CATNIP_CHUNK_HEAD + CATNIP_GZIP_CHUNK + sizeof( "\r\n" CATNIP_LAST_CHUNK )];
+};
 
 int
 main(argc, argv)
@@ -155,27 +294,81 @@ main(argc, argv)
 	int  body_fd;
 	char *webroot; // kitty (instead of www or webroot etc.)
 	int  usefork;  // use fork/chroot instead of path stripping
+	char *port;    // listen on this port ourselves instead of relaying via nc and kc
+	int  pipelines; // or with -p, run that many kc | nc | cn pipelines on it
+	char *kc;      // the kc those pipelines run
+	int  workers;  // or with -j, that many listeners sharing the port
+	int  pin;      // -A: each worker on its own CPU
 	verbosity = 0;  // debugging detail
+	errors = 0;
 
 	if (argc < 1)
 		usage();
 
 	numsig = SIGTERM;	// catnip now defaults to SIGTERM like kill's default SIGTERM; SIGCONT retains original kittycat behavior, SIGTERM only requires one signal per kittycat batch
+#ifdef KITTY_NIP_SIGNAL
+	numsig = KITTY_NIP_SIGNAL;	// or better, a queued real-time signal per file, see nip_kitty()
+#endif
 	kitty = ".kc"; // warning: default does not support concurrency in shared file namespace
 	head = "response.http"; // default response header output file path
 	body = "body";		// default body output file path
 	webroot = getenv("KITTY"); if( webroot == NULL)webroot = "kitty";	// default web root instead of www, -w can override env or default
 	usefork = 0;		// use path stripping by default, can use fork/chroot instead
+	port = NULL;		// pipeline (kc | nc | cn) by default
+	pipelines = 0;
+	workers = 0;
+	pin = 0;
+	kc = "kc";		// from PATH, unless we were run by path ourselves, then the kc next to us
+	if( argc > 0 && strrchr( argv[0], '/' ) != NULL ){
+		static char kc_path[PATH_MAX];
+		snprintf( kc_path, sizeof( kc_path ), "%.*skc", (int)( strrchr( argv[0], '/' ) + 1 - argv[0] ), argv[0] );
+		kc = kc_path;
+	}
 
-	while ((ch = getopt(argc, argv, "fk:s:vw:")) != -1)
+	while ((ch = getopt(argc, argv, "AB:C:E:efH:j:K:k:l:M:p:s:T:vw:Z:z:")) != -1)
 		switch (ch) {
+		case 'A':			/* pin -j workers to CPUs */
+			pin = 1;
+			break;
+		case 'B':			/* request body limit */
+			body_limit = parse_size( optarg );
+			break;
+		case 'C':			/* listener content cache budget, 0 for none */
+			content_budget = parse_size( optarg );
+			break;
+		case 'E':			/* listener backend */
+			if( strcmp( optarg, "auto" ) != 0 && strcmp( optarg, "epoll" ) != 0 && strcmp( optarg, "uring" ) != 0 )
+				errx(1, "-E %s: auto, epoll or uring", optarg);
+			backend = optarg;
+			break;
+		case 'e':			/* ETags from the content */
+			etag_hash = 1;
+			break;
+		case 'M':			/* biggest document to cache */
+			content_max = parse_size( optarg );
+			break;
+		case 'H':			/* request head limit */
+			header_limit = parse_size( optarg );
+			break;
 		case 'f':
 			++usefork;		/* use fork/chroot instead of path stripping */
 			fprintf( stderr, "catnip: fork/chroot style not yet implemented.\n" );
 			break;
+		case 'j':			/* prefork this many listeners on -l port */
+			workers = atoi( optarg );
+			break;
+		case 'K':			/* kc for -p pipelines */
+			kc = optarg;
+			break;
 		case 'k': 			/* kitty rendezvous path */
 			kitty = optarg;
 			break;
+		case 'l':			/* listen port, serve without nc and kc */
+			port = optarg;
+			break;
+		case 'p':			/* supervise this many pipelines on -l port */
+			pipelines = atoi( optarg );
+			break;
 		case 's':			/* kitty signal name/number */
 			if (isalpha(*optarg)) {
 				if ((numsig = signame_to_signum(optarg)) < 0)
@@ -189,18 +382,35 @@ main(argc, argv)
 			} else
 				nosig(optarg);
 			break;
+		case 'T':			/* handler threads per listener */
+			pool_threads = atoi( optarg );
+			break;
 		case 'v':			/* verbosity */
 			++verbosity;
 			break;
 		case 'w':			/* kitty webroot */
 			webroot = optarg;
 			break;
+		case 'Z':			/* gzipped bodies to keep */
+			zcache_budget = parse_size( optarg );
+			break;
+		case 'z':			/* gzip on the fly */
+			if( ( gzip_level = atoi( optarg ) ) < 0 || gzip_level > 9 )
+				errx(1, "-z %s: a gzip level, 1 to 9, or 0 for none", optarg);
+			break;
 		default:
 			usage();
 		}
 	argc -= optind;
 	argv += optind;
 
+	if( port != NULL && pipelines > 0 )
+		exit( supervise_pipelines( port, pipelines, kc, webroot, usefork ) );
+	if( port != NULL && workers > 0 )
+		exit( prefork_workers( port, workers, pin, webroot, usefork ) );
+	if( port != NULL )
+		exit( serve_http( port, webroot, usefork ) );
+
 	pid = 0; // for now. we had a race condition when we called read_kitty_marker() here.
 	// could check for webroot here, but for trace and others we don't need it
 	// printf( "catnip: argc = %d, pid = %d, numsig = %d, kitty = %s, head = %s, body = %s\n", argc, pid, numsig, kitty, head, body );
@@ -229,28 +439,38 @@ main(argc, argv)
 	parse_request( STDIN_FILENO, head_fd, body_fd, webroot, usefork );
 
 	// nip the kittycat once for header
+	errors |= nip_kitty( kitty, &pid, numsig, head, head_fd );
 	close(head_fd);
-	pid = read_kitty_marker( kitty ); // moved down here because of race condition
-	if( verbosity >= 0 )fprintf( stderr, "going to signal (nip) pid=%d\n", pid ); // we always want to know this
-	if( pid ){
-		if (kill(pid, numsig) == -1) {
-			warn("signalling %s", head);
-			errors = 1;
-		}
-	}
 
 	// nip the kittycat again for body
+	errors |= nip_kitty( kitty, &pid, numsig, body, body_fd );
 	close(body_fd);
-	if( pid ){
-		if (kill(pid, numsig) == -1) {
-			warn("signalling %s", body);
-			errors = 1;
-		}
-	}
 
+	if( verbosity >= 1 )print_stats( stderr );
 	exit(errors);
 }
 
+/*
+ * parse_size reads a byte count such as 4096, 64k or 16M.
+ */
+static size_t
+parse_size( char* arg )
+{
+	char* ep;
+	unsigned long long n;
+
+	errno = 0;
+	n = strtoull( arg, &ep, 10 );
+	switch( *ep ){
+	case 'g': case 'G': n <<= 10; /* FALLTHROUGH */
+	case 'm': case 'M': n <<= 10; /* FALLTHROUGH */
+	case 'k': case 'K': n <<= 10; ++ep; break;
+	}
+	if( errno || ep == arg || *ep )
+		errx(1, "illegal size: %s", arg);
+	return (size_t)n;
+}
+
 int
 signame_to_signum(sig)
 	char *sig;
@@ -283,8 +503,10 @@ usage()
 	// removing support for [{-s signal_name | -signal_name | -signal_number}]
 	// in favor of simply [-s {signal_name|signal_number}], for we're merely *derived* from kill(1)
 	// *not* forward compatible.
-	(void)fprintf(stderr, "%s\n",
-		"usage: cn [-f] [-k kitty_cat_file] [-s {signal_name|signal_number}] [-w webroot] [head [body]]");
+	(void)fprintf(stderr, "%s\n%s\n%s\n",
+		"usage: cn [-ef] [-B body_limit] [-H head_limit] [-k kitty_cat_file] [-s {signal_name|signal_number}] [-w webroot] [-z gzip_level] [head [body]]",
+		"       cn [-Aef] [-v] [-B body_limit] [-H head_limit] [-C cache_bytes] [-E backend] [-M max_cached] [-j workers] [-T threads] [-w webroot] [-z gzip_level] [-Z gzip_cache_bytes] -l port",
+		"       cn [-ef] [-v] [-B body_limit] [-H head_limit] [-K kc] [-w webroot] [-z gzip_level] -p pipelines -l port");
 	exit(1);
 }
 
@@ -312,37 +534,322 @@ read_kitty_marker( char* kitty )
 	return kitty_pid;
 }
 
+/*
+ * nip_kitty tells kc that name (open on fd) is ready: through the ring kc
+ * keeps next to its marker when there is one, else by signal to the PID in it.
+ * the marker is only looked at once the head is written, when kc has
+ * certainly made it (moved down here because of race condition).
+ * pid starts out 0 and remembers what the first nip found; -1 for the ring.
+ */
+static int
+nip_kitty( char* kitty, pid_t* pid, int numsig, char* name, int fd )
+{
+#ifdef __linux__
+	static struct kitty_ring* ring;
+	struct stat st;
+
+	static int looked;
+
+	if( !looked++ && kitty != NULL ){ // once, even when the caller already knows kc's pid
+		char path[PATH_MAX];
+		int kfd;
+		void* p;
+		snprintf( path, sizeof( path ), "%s%s", kitty, KITTY_RING_SUFFIX );
+		if( ( kfd = open( path, O_RDWR ) ) >= 0 ){
+			if( fstat( kfd, &st ) == 0 && st.st_size >= (off_t)sizeof( struct kitty_ring )
+			 && ( p = mmap( NULL, sizeof( struct kitty_ring ), PROT_READ|PROT_WRITE, MAP_SHARED, kfd, 0 ) ) != MAP_FAILED ){
+				ring = p;
+				if( __atomic_load_n( &ring->magic, __ATOMIC_ACQUIRE ) == KITTY_RING_MAGIC )
+					*pid = -1;
+				else{
+					munmap( p, sizeof( struct kitty_ring ) );
+					ring = NULL; // an older kc, or not yet ready
+				}
+			}
+			close( kfd );
+		}
+	}
+	if( *pid == -1 ){
+		if( verbosity >= 0 )fprintf( stderr, "going to nip through the ring for %s\n", name ); // we always want to know this
+		if( fstat( fd, &st ) < 0 )
+			st.st_size = -1;
+		if( kitty_ring_push( ring, name, st.st_size ) == 0 )
+			return 0;
+		warnx( "%s: kc is a whole ring behind, signalling instead", kitty );
+		*pid = 0;
+		munmap( ring, sizeof( struct kitty_ring ) );
+		ring = NULL;
+	}
+#endif
+	if( *pid == 0 ){
+		*pid = read_kitty_marker( kitty );
+		if( verbosity >= 0 )fprintf( stderr, "going to signal (nip) pid=%d\n", *pid ); // we always want to know this
+	}
+	if( *pid <= 0 )
+		return 0;
+#ifdef KITTY_NIP_SIGNAL
+	// sigqueue says which nip this is; with the real-time KITTY_NIP_SIGNAL
+	// both nips stay queued even when kc is busy catting
+	static int nips;
+	union sigval value;
+	value.sival_int = ++nips;
+	if( sigqueue( *pid, numsig, value ) == -1 ){
+#else
+	if( kill( *pid, numsig ) == -1 ){
+#endif
+		warn("signalling %s", name);
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * requests (struct, buffer and arena) are recycled through a free list
+ * rather than going back to malloc; the listener goes through one per connection.
+ */
+#define CATNIP_REQUEST_BSIZE 4096	// initial buffer, grows as needed
+#define CATNIP_ARENA_SIZE 4096		// initial arena, grows to fit the biggest request seen
+#define CATNIP_POOL_MAX 1024		// most requests kept on the free list
+static struct http_request* request_pool;
+static int request_pool_count;
+
 struct http_request* alloc_http_request(){
 	struct http_request* req;
 	
-	if((req = malloc(sizeof(struct http_request))) == NULL)
+	if( ( req = request_pool ) != NULL ){
+		request_pool = req->next_free;
+		--request_pool_count;
+		++stats.pooled;
+	}
+	else if((req = catnip_malloc(sizeof(struct http_request))) == NULL)
 		err(1, "struct");
 	else{
-		req->bsize = 4096; // assumed header line maximum
+		req->bsize = CATNIP_REQUEST_BSIZE; // assumed header line maximum
 		req->buf = NULL;
-		if((req->buf = malloc(req->bsize)) == NULL)
+		if((req->buf = catnip_malloc(req->bsize)) == NULL)
 			err(1, "buffer");
-		else{
-			req->state = WANT_METHOD; // that's how the request begins
-			req->method = NULL; 
-			req->target = NULL;
-			req->version = NULL;
-			req->hk = NULL;
-			req->hv = NULL;
-			req->server = NULL;
-			req->port = NULL;
-			req->body = NULL;
-			req->message = NULL;
-			req->content_type = NULL;
-			req->other_headers = NULL;
-			req->map = NULL; // method-action pointer
-			req->vp = NULL; // version-map pointer
-			req->e = 0; // presumed innocent
-		}
+		memset( &req->arena, 0, sizeof( req->arena ) );
+		req->arena.size = CATNIP_ARENA_SIZE;
+		if( ( req->arena.base = catnip_malloc( req->arena.size ) ) == NULL )
+			err(1, "arena");
+		req->doc_fd = -1;
+		req->zvar = NULL;
 	}
+	req->nr = 0; // nothing read
+	req->allow_keep_alive = 0; // up to the caller
+	reset_http_request( req );
 	return req;
 }
 
+/*
+ * reset_http_request gets req ready to parse from the top of req->buf,
+ * keeping whatever has been read into it and the caller's context.
+ */
+void reset_http_request( struct http_request* req ){
+	req->state = WANT_METHOD; // that's how the request begins
+	req->np = 0; // nothing parsed
+	req->method = req->buf; // assumption for entering WANT_METHOD
+	req->target = NULL;
+	req->version = NULL;
+	req->hk = NULL;
+	req->hv = NULL;
+	req->server = NULL;
+	req->port = NULL;
+	req->body = NULL;
+	req->body_length = 0;
+	req->body_pending = 0;
+	req->message = NULL;
+	req->content_type = NULL;
+	req->other_headers = NULL;
+	req->map = NULL; // method-action pointer
+	req->vp = NULL; // version-map pointer
+	req->e = 0; // presumed innocent
+	req->hid = HEADER_UNKNOWN;
+	memset( req->headers, 0, sizeof( req->headers ) );
+	req->content_length = -1; // no body unless told otherwise
+	req->keep_alive = 0; // until we know the version
+	if( req->doc_fd >= 0 )
+		release_doc( req->doc_fd, req->doc_meta );
+	req->doc_fd = -1; // no body staged yet
+	req->doc_meta = NULL;
+	req->doc_path = NULL;
+	req->doc_errno = 0;
+	req->doc_length = 0;
+	req->ranges = NULL;
+	req->range_count = 0;
+	req->boundary = NULL;
+	req->range_type = NULL;
+	if( req->zvar != NULL )
+		zcache_release( req->zvar );
+	req->zvar = NULL;
+	req->deflating = 0;
+	req->chunked = 0;
+	req->reply = NULL;
+	req->reply_length = 0;
+	reset_response_headers( req );
+	arena_reset( &req->arena );
+}
+
+/*
+ * next_http_request moves any bytes read past the end of the current request
+ * (a pipelined follower) to the top of the buffer and starts over on them.
+ */
+static void
+next_http_request( struct http_request* req )
+{
+	ssize_t end = ( req->body - req->buf ) + req->body_length;
+	memmove( req->buf, req->buf + end, req->nr - end );
+	req->nr -= end;
+	reset_http_request( req );
+}
+
+void free_http_request( struct http_request* req ){
+	if( req == NULL )
+		return;
+	if( req->doc_fd >= 0 )
+		release_doc( req->doc_fd, req->doc_meta );
+	req->doc_fd = -1;
+	if( req->zvar != NULL )
+		zcache_release( req->zvar );
+	req->zvar = NULL;
+	if( request_pool_count < CATNIP_POOL_MAX ){
+		if( req->bsize > 16 * CATNIP_REQUEST_BSIZE ){ // do not hoard the odd huge body
+			free( req->buf );
+			req->bsize = CATNIP_REQUEST_BSIZE;
+			if( ( req->buf = catnip_malloc( req->bsize ) ) == NULL )
+				err(1, "buffer");
+		}
+		req->next_free = request_pool; // keep it, buffer, arena and all
+		request_pool = req;
+		++request_pool_count;
+		return;
+	}
+	arena_reset( &req->arena );
+	free( req->arena.base );
+	free( req->buf );
+	free( req );
+}
+
+/*
+ * catnip_malloc and friends count every trip to the allocator, so -v and
+ * SIGUSR1 can show that a warm listener serves requests without any.
+ */
+static void*
+catnip_malloc( size_t size )
+{
+	__atomic_add_fetch( &stats.mallocs, 1, __ATOMIC_RELAXED ); // pool threads allocate too
+	return malloc( size );
+}
+
+static void*
+catnip_calloc( size_t n, size_t size )
+{
+	__atomic_add_fetch( &stats.mallocs, 1, __ATOMIC_RELAXED );
+	return calloc( n, size );
+}
+
+static void*
+catnip_realloc( void* p, size_t size )
+{
+	__atomic_add_fetch( &stats.mallocs, 1, __ATOMIC_RELAXED );
+	return realloc( p, size );
+}
+
+/*
+ * arena_alloc hands out request-lifetime memory from the request's arena.
+ * when base is full we spill into an overflow chunk; the next arena_reset()
+ * frees those and grows base to fit, so steady state never spills. NULL
+ * when there is no memory for a chunk either: the request gets a 500,
+ * the listener carries on.
+ */
+struct catnip_arena_chunk {
+	struct catnip_arena_chunk* next;
+	size_t	size;
+	size_t	used;
+	char	data[];
+};
+
+#define ARENA_ALIGN(n) ( ( (n) + 15 ) & ~(size_t)15 )
+
+static void*
+arena_alloc( struct catnip_arena* a, size_t size )
+{
+	struct catnip_arena_chunk* c;
+	void* p;
+
+	size = ARENA_ALIGN( size );
+	if( a->used + size <= a->size ){
+		p = a->base + a->used;
+		a->used += size;
+		return p;
+	}
+	if( ( c = a->overflow ) == NULL || c->used + size > c->size ){
+		size_t csize = size > a->size ? size : a->size;
+		if( ( c = catnip_malloc( sizeof( struct catnip_arena_chunk ) + csize ) ) == NULL ){
+			warn( "arena" );
+			return NULL;
+		}
+		c->size = csize;
+		c->used = 0;
+		c->next = a->overflow;
+		a->overflow = c;
+	}
+	p = c->data + c->used;
+	c->used += size;
+	a->spilled += size;
+	return p;
+}
+
+static char*
+arena_strdup( struct catnip_arena* a, char* s )
+{
+	size_t n = strlen( s ) + 1;
+	char* p;
+
+	if( ( p = arena_alloc( a, n ) ) == NULL )
+		return NULL;
+	return memcpy( p, s, n );
+}
+
+static void
+arena_reset( struct catnip_arena* a )
+{
+	struct catnip_arena_chunk* c;
+
+	a->used = 0;
+	if( a->overflow == NULL )
+		return; // the usual O(1) case
+	while( ( c = a->overflow ) != NULL ){
+		a->overflow = c->next;
+		free( c );
+	}
+	free( a->base ); // grow so next time it all fits
+	a->size += ARENA_ALIGN( a->spilled );
+	if( ( a->base = catnip_malloc( a->size ) ) == NULL )
+		err(1, "arena");
+	a->spilled = 0;
+}
+
+static void
+print_stats( FILE* fp )
+{
+	fprintf( fp, "catnip: %lu requests (%lu not modified), %lu mallocs, %lu pooled\n", stats.requests, stats.not_modified, stats.mallocs, stats.pooled );
+	if( stats.meta_hits || stats.meta_misses )
+		fprintf( fp, "catnip: meta cache %lu hits, %lu misses, %lu invalidated\n", stats.meta_hits, stats.meta_misses, stats.meta_invalidations );
+	if( stats.content_hits || stats.content_misses )
+		fprintf( fp, "catnip: content cache %lu hits, %lu misses, %lu evictions, %zu of %zu bytes\n",
+			stats.content_hits, stats.content_misses, stats.content_evictions, stats.content_bytes, content_budget );
+	if( stats.pool_jobs )
+		fprintf( fp, "catnip: pool of %d threads, %lu jobs, %lu stolen, queue depth %lu now, %lu max, %.2f mean\n",
+			pool_threads, stats.pool_jobs, stats.pool_stolen, stats.pool_depth, stats.pool_depth_max,
+			(double)stats.pool_depth_total / stats.pool_jobs );
+	if( stats.uring_enters )
+		fprintf( fp, "catnip: io_uring %lu operations in %lu enters\n", stats.uring_sqes, stats.uring_enters );
+	if( stats.gzip_streams || stats.zcache_hits )
+		fprintf( fp, "catnip: gzip %lu streamed, %lu from the variant cache, %lu evictions, %zu of %zu bytes\n",
+			stats.gzip_streams, stats.zcache_hits, stats.zcache_evictions, stats.zcache_bytes, zcache_budget );
+}
+
 /*
  * Parse the input stream from:
  * - nc (netcat)
@@ -358,232 +865,834 @@ static void
 parse_request(int rfd, int head_fd, int body_fd, char* webroot, int usefork)
 {
 	struct http_request* req;
-	char* p;
-	char c;
+	struct catnip_buffer head = { NULL, 0, 0, 0 };
+	ssize_t n;
 
 	if( ( req = alloc_http_request() ) == NULL || req->buf == NULL )
 		return;
 	req->webroot = webroot;
 	req->usefork = usefork;
 	//
-	// BUF-BUG: though originally intended to chain buffers for multiple reads, only one buffer is tracked
-	// in this current implementation. subsequent reads will overwrite the old data, rendering all
-	// references into it invalid after the first pass. handling requests with large headers or 
-	// body of any significant size are *not* currently supported.
+	// formerly BUF-BUG: one buffer, read once. the parser now resumes across reads and
+	// grows the buffer (within header_limit and body_limit) whenever it needs more.
 	//
-	for( p = req->buf; (req->nr = read(rfd, req->buf, req->bsize)) > 0; ){
-		if( verbosity >= 1 )fprintf( stderr, "read %ld bytes\n", req->nr );
+	while( parse_http_request( req ) == PARSE_NEED_MORE ){
+		if( ( n = read( rfd, req->buf + req->nr, req->bsize - req->nr ) ) <= 0 ){
+			req->e = 400; // the stream ended part way through
+			req->message = "Bad Request - incomplete";
+			break;
+		}
+		if( verbosity >= 1 )fprintf( stderr, "read %ld bytes\n", n );
 		if( verbosity >= 2 ){
-			for( int i = 0; i < req->nr; ++i ){
-				fprintf( stderr, "%2x ", req->buf[i] );
+			for( int i = 0; i < n; ++i ){
+				fprintf( stderr, "%2x ", req->buf[req->nr + i] );
 			}
 			fprintf( stderr, ";\n" );
 		}
-		req->method = p; // assumption for entering WANT_METHOD
-		// NOT sscanf( p, "%s %s %s\n", &method, &target, &version );
-		for( req->np = 0; req->np < req->nr && ( c = *p ) != '\0' && !req->e && req->state != WANT_BODY; ++p, ++req->np ){
-			switch( c ){
-			case '\r': // need to change some logic if this is real - percolated up!
-				*p = '\0'; // terminate any field, ahead of '\n'
-				if( req->hk == p )
-					++req->hk;
-				break; // but do *NOT* change state...
-			case ' ':
-				switch( req->state ){
-				case WANT_METHOD:
-					*p = '\0'; // terminate the method name
-					req->state = WANT_TARGET;
-					req->target = p+1; // assumption when entering WANT_TARGET
-					// check method at this point
-					for( req->map = http_methods; req->map && req->map->method != NULL; ++req->map ){
-						if( strcmp( req->method, req->map->method ) == 0 ){
-							// we have a winner, retain map value
-							break;
-						}
-					}
-					if( req->map->method == NULL ){
-						// no match
-						req->map = NULL; // simplifies check later
-						req->e = 400; // bad request: method
-						req->message = "Bad Request - method";
-					}
-					break;
-				case WANT_TARGET:
-					*p = '\0'; // terminate the target (URL or short path)
-					req->state = WANT_VERSION;
-					req->version = p+1; // assumption when entering WANT_VERSION
-					break;
-				case WANT_VERSION:
-					// not expecting spaces within the HTTP version
-					// should flag an error
-					if( verbosity >= 1 )fprintf( stderr, "spaces within http version\n" );
-					req->e = 505; // unsupported version, or 400 bad request
-					break;
-				case WANT_HEADER_KEY:
-					*p = '\0'; // this is *after* the colon hopefully
-					req->state = WANT_HEADER_VALUE;
-					req->hv = p+1; // set up to accumulate value next
-					break;
-				case WANT_HEADER_VALUE:
-					// let them accumulate within the value
-					if( p == req->hv ){ // except
-						*p = '\0'; // eat the leading space
-						req->hv = p+1; // as it is ignored
-					}
-					break;
-				case WANT_BODY:
-					// whatever - we should have stopped by now
-					break;
-				case ERROR_STATE:	
-					// should be unreachable
-					break;
+		req->nr += n;
+	}
+	if( req->e ){
+		// some error in parsing
+		if( verbosity >= 0 )fprintf( stderr, "got error code %d while parsing, state = %d\n", req->e, req->state );
+	}
+	dispatch_request( req );
+	write_http_response( &head, req );
+	// be sure to save all data to either the response header file or the body output file
+	// because this ship is going down...
+	buffer_flush( head_fd, &head );
+	free( head.data );
+	if( write_http_body( body_fd, req ) == 0 && req->body_pending > 0 )
+		echo_http_body( rfd, body_fd, req );
+	free_http_request( req );
+}
+
+/*
+ * the parser only acts on ' ', ':', '\r', '\n' (and '\0', which it refuses);
+ * every other byte simply accumulates in the current field. so rather than
+ * switch on each byte, we look for the next delimiter 16 (SSE2) or 32 (AVX2)
+ * bytes at a time and run the state machine only there. the scalar scanner
+ * is the reference; CATNIP_SCAN=scalar|sse2|avx2 in the environment picks
+ * one by hand, otherwise the best the CPU supports wins.
+ */
+typedef char* (*delimiter_scanner)( char* p, char* end );
+
+static int
+is_delimiter( char c )
+{
+	return c == ' ' || c == ':' || c == '\r' || c == '\n' || c == '\0';
+}
+
+static char*
+scan_delimiters_scalar( char* p, char* end )
+{
+	while( p < end && !is_delimiter( *p ) )
+		++p;
+	return p;
+}
+
+#if defined(__GNUC__) && defined(__SSE2__)
+#include <immintrin.h>
+#define CATNIP_SIMD_SCAN
+
+static char*
+scan_delimiters_sse2( char* p, char* end )
+{
+	const __m128i sp = _mm_set1_epi8( ' ' ), co = _mm_set1_epi8( ':' ), cr = _mm_set1_epi8( '\r' );
+	const __m128i lf = _mm_set1_epi8( '\n' ), nul = _mm_setzero_si128();
+
+	for( ; end - p >= 16; p += 16 ){
+		__m128i v = _mm_loadu_si128( (const __m128i*)p );
+		__m128i hit = _mm_or_si128( _mm_or_si128( _mm_cmpeq_epi8( v, sp ), _mm_cmpeq_epi8( v, co ) ),
+		    _mm_or_si128( _mm_or_si128( _mm_cmpeq_epi8( v, cr ), _mm_cmpeq_epi8( v, lf ) ), _mm_cmpeq_epi8( v, nul ) ) );
+		unsigned mask = (unsigned)_mm_movemask_epi8( hit );
+		if( mask )
+			return p + __builtin_ctz( mask );
+	}
+	return scan_delimiters_scalar( p, end );
+}
+
+__attribute__((target("avx2")))
+static char*
+scan_delimiters_avx2( char* p, char* end )
+{
+	const __m256i sp = _mm256_set1_epi8( ' ' ), co = _mm256_set1_epi8( ':' ), cr = _mm256_set1_epi8( '\r' );
+	const __m256i lf = _mm256_set1_epi8( '\n' ), nul = _mm256_setzero_si256();
+
+	for( ; end - p >= 32; p += 32 ){
+		__m256i v = _mm256_loadu_si256( (const __m256i*)p );
+		__m256i hit = _mm256_or_si256( _mm256_or_si256( _mm256_cmpeq_epi8( v, sp ), _mm256_cmpeq_epi8( v, co ) ),
+		    _mm256_or_si256( _mm256_or_si256( _mm256_cmpeq_epi8( v, cr ), _mm256_cmpeq_epi8( v, lf ) ), _mm256_cmpeq_epi8( v, nul ) ) );
+		unsigned mask = (unsigned)_mm256_movemask_epi8( hit );
+		if( mask )
+			return p + __builtin_ctz( mask );
+	}
+	return scan_delimiters_sse2( p, end );
+}
+#endif
+
+static delimiter_scanner scan_delimiters = NULL;
+
+static void
+choose_delimiter_scanner()
+{
+	char* want = getenv( "CATNIP_SCAN" );
+	char* name = "scalar";
+
+	scan_delimiters = scan_delimiters_scalar;
+#ifdef CATNIP_SIMD_SCAN
+	if( want == NULL || strcmp( want, "scalar" ) != 0 ){
+		scan_delimiters = scan_delimiters_sse2;
+		name = "sse2";
+		__builtin_cpu_init();
+		if( ( want == NULL || strcmp( want, "sse2" ) != 0 ) && __builtin_cpu_supports( "avx2" ) ){
+			scan_delimiters = scan_delimiters_avx2;
+			name = "avx2";
+		}
+	}
+#endif
+	if( verbosity >= 1 )fprintf( stderr, "catnip: delimiter scan %s\n", name );
+}
+
+/*
+ * parse_http_request runs the state machine over whatever has arrived since
+ * the last call: req->np bytes of req->buf have been parsed, req->nr have been read.
+ * all the field pointers point into req->buf, so the caller only ever appends;
+ * on PARSE_NEED_MORE we have already made room for the next read.
+ *
+ * the head may take up to header_limit bytes (else 431), and a body announced by
+ * Content-Length up to body_limit (else 413). without a Content-Length a persistent
+ * connection has no body; otherwise, as ever, the body is whatever followed the head.
+ */
+static enum http_parse_result
+parse_http_request( struct http_request* req )
+{
+	char* p;
+	char* end;
+	char c;
+	off_t buffered;
+
+	if( scan_delimiters == NULL )
+		choose_delimiter_scanner();
+	// NOT sscanf( p, "%s %s %s\n", &method, &target, &version );
+	end = req->buf + req->nr;
+	for( p = req->buf + req->np; p < end && !req->e && req->state != WANT_BODY; ++p ){
+		if( ( p = scan_delimiters( p, end ) ) == end )
+			break; // nothing but field bytes left, they accumulate
+		switch( c = *p ){
+		case '\0': // would end every string we hand out early
+			req->e = 400;
+			req->message = "Bad Request - null byte";
+			break;
+		case '\r': // need to change some logic if this is real - percolated up!
+			*p = '\0'; // terminate any field, ahead of '\n'
+			if( req->hk == p )
+				++req->hk;
+			break; // but do *NOT* change state...
+		case ':':
+			if( req->state == WANT_HEADER_KEY ){
+				*p = '\0'; // terminate the header key
+				req->hid = lookup_header( req->hk, p - req->hk );
+				req->state = WANT_HEADER_VALUE;
+				req->hv = p+1; // set up to accumulate value next
+			}
+			break; // otherwise part of a target or value
+		case ' ':
+			switch( req->state ){
+			case WANT_METHOD:
+				*p = '\0'; // terminate the method name
+				req->state = WANT_TARGET;
+				req->target = p+1; // assumption when entering WANT_TARGET
+				// check method at this point
+				if( ( req->map = lookup_method( req->method, p - req->method ) ) == NULL ){
+					// no match
+					req->e = 400; // bad request: method
+					req->message = "Bad Request - method";
 				}
 				break;
-			case '\n':
-				switch( req->state ){
-				case WANT_VERSION:
-					*p = '\0'; // terminate the version 
-					req->state = WANT_HEADER_KEY;
-					req->hk = p+1; // assuming a header-key comes next
-					// check version at this point
-					if( verbosity >= 1 )fprintf( stderr, "checking http version %s;\n", req->version );
-					for( req->vp = http_versions; req->vp && req->vp->version != NULL; ++req->vp ){
-						if( verbosity >= 2 )fprintf( stderr, "is http version %s?\n", req->vp->version );
-						if( strcmp( req->version, req->vp->version ) == 0 ){
-							// we have a winner, retain vp value
-							break;
-						}
-					}
-					if( req->vp->version == NULL ){
-						// no match
-						if( verbosity >= 1 )fprintf( stderr, "no matching http version for %s;\n", req->version );
-						req->vp = NULL;
-						req->e = 505; // unsupported version
-					}
-					break;
-				case WANT_HEADER_VALUE:
-					*p = '\0'; // terminate the header value
-					req->state = WANT_HEADER_KEY;
-					// preprocess this header now - must save (hk,hv)
-					if( verbosity >= 1 )fprintf( stderr, "catnip: should process header: (%s,%s)\n", req->hk, req->hv );
-					req->state = WANT_HEADER_KEY; // get set for the next one
-					req->hk = p+1; // assuming a header-key comes next
-					req->hv = NULL;
-					break;
-				case WANT_HEADER_KEY:
-					// if at very beginning, is beginning of body
-					if( p == req->hk ){
-						req->state = WANT_BODY;
-						req->body = p+1;
-					}
-					else {
-						*p = '\0'; // terminate only to show error
-						if( verbosity >= 1 )fprintf( stderr, "null header value, k=[%s]\n", req->hk );
-						req->e = 400; // bad request - null header value
-						req->message = "Bad Request - null header";
-					}
-					break;
-				default:
-					// signal unexpected newline
-					req->e = 400; // bad request - malformed
-					req->message = "Bad Request - unexpected newline";
-					break;
+			case WANT_TARGET:
+				*p = '\0'; // terminate the target (URL or short path)
+				req->state = WANT_VERSION;
+				req->version = p+1; // assumption when entering WANT_VERSION
+				break;
+			case WANT_VERSION:
+				// not expecting spaces within the HTTP version
+				// should flag an error
+				if( verbosity >= 1 )fprintf( stderr, "spaces within http version\n" );
+				req->e = 505; // unsupported version, or 400 bad request
+				break;
+			case WANT_HEADER_KEY:
+				// no whitespace allowed ahead of the colon, nor obsolete line folding
+				req->e = 400;
+				req->message = "Bad Request - space in header name";
+				break;
+			case WANT_HEADER_VALUE:
+				// let them accumulate within the value
+				if( p == req->hv ){ // except
+					*p = '\0'; // eat the leading space
+					req->hv = p+1; // as it is ignored
+				}
+				break;
+			case WANT_BODY:
+				// whatever - we should have stopped by now
+				break;
+			case ERROR_STATE:	
+				// should be unreachable
+				break;
+			}
+			break;
+		case '\n':
+			switch( req->state ){
+			case WANT_VERSION:
+				*p = '\0'; // terminate the version 
+				req->state = WANT_HEADER_KEY;
+				req->hk = p+1; // assuming a header-key comes next
+				// check version at this point
+				if( verbosity >= 1 )fprintf( stderr, "checking http version %s;\n", req->version );
+				if( ( req->vp = lookup_version( req->version, strlen( req->version ) ) ) == NULL ){
+					// no match
+					if( verbosity >= 1 )fprintf( stderr, "no matching http version for %s;\n", req->version );
+					req->e = 505; // unsupported version
+				}
+				else
+					req->keep_alive = req->vp->keep_alive; // until a Connection: header says otherwise
+				break;
+			case WANT_HEADER_VALUE:
+				*p = '\0'; // terminate the header value
+				req->state = WANT_HEADER_KEY;
+				// preprocess this header now - must save (hk,hv)
+				if( verbosity >= 1 )fprintf( stderr, "catnip: should process header: (%s,%s)\n", req->hk, req->hv );
+				process_request_header( req );
+				req->state = WANT_HEADER_KEY; // get set for the next one
+				req->hk = p+1; // assuming a header-key comes next
+				req->hv = NULL;
+				break;
+			case WANT_HEADER_KEY:
+				// if at very beginning, is beginning of body
+				if( p == req->hk ){
+					req->state = WANT_BODY;
+					req->body = p+1;
+				}
+				else {
+					*p = '\0'; // terminate only to show error
+					if( verbosity >= 1 )fprintf( stderr, "null header value, k=[%s]\n", req->hk );
+					req->e = 400; // bad request - null header value
+					req->message = "Bad Request - null header";
 				}
 				break;
-			default: // most other characters (non-delimiters) will ... 
-				// ...accumulate in the current field
+			default:
+				// signal unexpected newline
+				req->e = 400; // bad request - malformed
+				req->message = "Bad Request - unexpected newline";
 				break;
 			}
-		}
-		if( req->e ){
-			// some error in parsing
-			if( verbosity >= 0 )fprintf( stderr, "got error code %d while parsing, state = %d\n", req->e, req->state );
+			break;
+		default: // most other characters (non-delimiters) will ... 
+			// ...accumulate in the current field (scan_delimiters skips them)
 			break;
 		}
-		// TEMPORARY, or PERMANENT, see BUF-BUG note.
-		break; // because BUF-BUG mentioned at top does not allow multiple buf, we cannot allow overwrite!
 	}
-	if( verbosity >= 1 ){
-		fprintf( stderr, "catnip: request parsing summary; " );
-		if( req->method != NULL )fprintf( stderr, "method=%s; ", req->method );
-		if( req->target != NULL )fprintf( stderr, "target=%s; ", req->target );
-		if( req->version != NULL )fprintf( stderr, "version=%s; ", req->version );
-		fprintf( stderr, ";\n" );
-		fprintf( stderr, "e = %d, state = %d, map = %ld;\n", req->e, req->state, (long)req->map ); // debug
-									    }
-	if( req->e == 0 && req->state == WANT_BODY ){
-		if( req->map != NULL ){
-			reset_response_headers();
-			if( verbosity >= 1 )fprintf( stderr, "catnip: trying action %s\n", req->map->method );
-			req->body_length = req->nr - (p - req->buf);
-			// old method action took ( body_fd, req->body, req->nr - (p - req->buf) )
-			req->e = (*req->map->action)( body_fd, req );
-			if( verbosity >= 1 )fprintf( stderr, "catnip: back from action %s, e = %d\n", req->map->method, req->e );
+	req->np = p - req->buf;
+	if( req->e )
+		return PARSE_ERROR;
+	if( req->state != WANT_BODY ){
+		if( (size_t)req->np >= header_limit || grow_http_request( req, req->nr + 1 ) ){
+			req->e = 431;
+			req->message = "Request Header Fields Too Large";
+			return PARSE_ERROR;
 		}
+		return PARSE_NEED_MORE;
 	}
-	write_http_response( head_fd, req->version, req->e, req->message, req->content_type, req->other_headers );
-	// be sure to save all data to either the response header file or the body output file
-	// because this ship is going down...
-	if( req->buf != NULL )
-		free( req->buf );
-	if( req != NULL )
-		free( req );
-}
-
-// globals. ew!
-#define CATNIP_MAX_RESPONSE_HEADERS 16
-int response_header_count;
-struct key_value_pair {
-	char*	key;
-	char*	value;
-};
-struct key_value_pair response_headers[CATNIP_MAX_RESPONSE_HEADERS];
+	buffered = req->nr - ( req->body - req->buf );
+	if( req->content_length >= 0 ){
+		if( buffered < req->content_length && req->map->action == http_trace
+		 && req->vp != NULL && req->vp->http_version == HTTP_1_1 ){
+			// no need to hold it all, or wait for it: the echo goes out chunked as it comes in
+			req->body_length = buffered;
+			req->body_pending = req->content_length - buffered;
+			return PARSE_DONE;
+		}
+		if( req->content_length > body_limit ){
+			req->e = 413;
+			req->message = "Payload Too Large";
+			return PARSE_ERROR;
+		}
+		if( buffered < req->content_length ){
+			if( grow_http_request( req, ( req->body - req->buf ) + req->content_length ) ){
+				req->e = 500;
+				req->message = "Internal Server Error - request buffer";
+				return PARSE_ERROR;
+			}
+			return PARSE_NEED_MORE;
+		}
+		req->body_length = req->content_length;
+	}
+	else
+		req->body_length = req->keep_alive && req->allow_keep_alive ? 0 : buffered;
+	return PARSE_DONE;
+}
 
-void reset_response_headers(){
-	response_header_count = 0;
+/*
+ * grow_http_request makes room for at least want bytes in req->buf, doubling,
+ * and moves every field pointer along with the data. nonzero if it cannot.
+ */
+#define REBASE(field) if( req->field != NULL ) req->field = buf + ( req->field - req->buf )
+static int
+grow_http_request( struct http_request* req, size_t want )
+{
+	size_t bsize = req->bsize;
+	char* buf;
+
+	if( want <= bsize )
+		return 0;
+	while( bsize < want )
+		bsize *= 2;
+	if( ( buf = catnip_malloc( bsize ) ) == NULL )
+		return 1;
+	memcpy( buf, req->buf, req->nr );
+	REBASE( method );
+	REBASE( target );
+	REBASE( version );
+	REBASE( hk );
+	REBASE( hv );
+	REBASE( body );
+	for( int i = 0; i < HEADER_COUNT; ++i )
+		REBASE( headers[i] );
+	free( req->buf );
+	req->buf = buf;
+	req->bsize = bsize;
+	if( verbosity >= 1 )fprintf( stderr, "catnip: request buffer grown to %lu\n", (unsigned long)bsize );
+	return 0;
 }
+#undef REBASE
 
-void add_response_header( char* key, char* value ){
-	if( response_header_count < CATNIP_MAX_RESPONSE_HEADERS ){
-		struct key_value_pair* kvp;
-		kvp = &response_headers[response_header_count];
-		kvp->key = malloc( strlen( key ) + 1 );
-		kvp->value = malloc( strlen( value ) + 1 );
-		if( kvp->key == NULL || kvp->value == NULL )
-			return; // silently return for now: BUG, & leak: should free other
-		strcpy( kvp->key, key );
-		strcpy( kvp->value, value );
-		++response_header_count;
-	}
-	// else silently drop for now: BUG
+/*
+ * lookups against the perfect hash tables in catnip-hash.h:
+ * one catnip_hash() to find the only candidate, one compare to confirm it.
+ */
+static struct method_action*
+lookup_method( char* s, size_t len )
+{
+	int i = catnip_method_slot[catnip_hash( s, len, CATNIP_METHOD_SEED, 0 ) & ( CATNIP_METHOD_SLOTS - 1 )];
+	if( i < 0 || strncmp( http_methods[i].method, s, len ) != 0 || http_methods[i].method[len] != '\0' )
+		return NULL;
+	return &http_methods[i];
 }
 
-void write_response_headers( int head_fd ){
-	for( int i = 0; i < response_header_count; ++i ){
-		dprintf( head_fd, "%s: %s\n", response_headers[i].key, response_headers[i].value );
-	}
+static struct version_map*
+lookup_version( char* s, size_t len )
+{
+	int i = catnip_version_slot[catnip_hash( s, len, CATNIP_VERSION_SEED, 0 ) & ( CATNIP_VERSION_SLOTS - 1 )];
+	if( i < 0 || strncmp( http_versions[i].version, s, len ) != 0 || http_versions[i].version[len] != '\0' )
+		return NULL;
+	return &http_versions[i];
 }
 
-// Write a response to the "header" channel - perhaps to be relayed by kc to nc:
-//
-// HTTP/1.1 200 Everything Is Just Fine
-// Server: netcat!
-// Content-Type: text/html; charset=UTF-8
-// (this line intentionally left blank)
+static enum http_header
+lookup_header( char* s, size_t len )
+{
+	int i = catnip_header_slot[catnip_hash( s, len, CATNIP_HEADER_SEED, 1 ) & ( CATNIP_HEADER_SLOTS - 1 )];
+	if( i < 0 || strncasecmp( http_headers[i], s, len ) != 0 || http_headers[i][len] != '\0' )
+		return HEADER_UNKNOWN;
+	return (enum http_header)i;
+}
+
+/*
+ * process_request_header looks at the (hk,hv) pair just completed.
+ * any header we know by name is kept in req->headers[] for the actions;
+ * the ones that frame the exchange we act on right away.
+ */
 static void
-write_http_response( int head_fd, char* version, int status, char* message, char* content_type, char** other_headers )
+process_request_header( struct http_request* req )
 {
-	dprintf( head_fd, "%s %d %s\n", version, status, message == NULL ? "nominal" : message );
-	dprintf( head_fd, "Server: catnip (cn) 0.0.1\n" );
-	dprintf( head_fd, "Content-Type: %s\n", content_type == NULL ? "text/html; charset=UTF-8" : content_type );
-	// consider other headers too? which request headers should also be response headers?
-	// which additional headers should be added in? such as size? 
-	write_response_headers( head_fd );
-	dprintf( head_fd, "\n" ); // done with the headers, on to the body! (well, the end of this file, let kc cat them)
+	char* ep;
+
+	if( req->hid == HEADER_UNKNOWN )
+		return;
+	if( req->headers[req->hid] == NULL )
+		req->headers[req->hid] = req->hv; // first one wins
+	switch( req->hid ){
+	case HEADER_CONNECTION:
+		if( header_has_token( req->hv, "close" ) )
+			req->keep_alive = 0;
+		else if( header_has_token( req->hv, "keep-alive" ) )
+			req->keep_alive = 1;
+		break;
+	case HEADER_CONTENT_LENGTH:
+		errno = 0;
+		req->content_length = strtoll( req->hv, &ep, 10 );
+		if( errno || ep == req->hv || *ep != '\0' || req->content_length < 0 ){
+			req->e = 400;
+			req->message = "Bad Request - Content-Length";
+		}
+		break;
+	case HEADER_TRANSFER_ENCODING:
+		req->e = 501; // no chunked request bodies (yet), and we will not guess where this one ends
+		req->message = "Not Implemented - Transfer-Encoding";
+		break;
+	default:
+		break; // kept for whoever asks
+	}
 }
 
 /*
- * if we are running in fork/chroot mode, then we can just use our webroot 
+ * header_has_token finds token (case-insensitively) in a comma separated header value.
+ */
+static int
+header_has_token( char* value, char* token )
+{
+	size_t tl = strlen( token );
+	char* p = value;
+
+	while( p != NULL && *p ){
+		while( *p == ' ' || *p == '\t' || *p == ',' )
+			++p;
+		if( strncasecmp( p, token, tl ) == 0 && ( p[tl] == '\0' || p[tl] == ',' || p[tl] == ' ' || p[tl] == ';' ) )
+			return 1;
+		p = strchr( p, ',' );
+	}
+	return 0;
+}
+
+/*
+ * dispatch_request hands a parsed request to its method action, which
+ * stages any body in req (doc_fd or reply) for whoever writes the response,
+ * then adds the framing headers the action left to us.
+ */
+static void
+dispatch_request( struct http_request* req )
+{
+	int e;
+
+	if( verbosity >= 1 ){
+		fprintf( stderr, "catnip: request parsing summary; " );
+		if( req->method != NULL )fprintf( stderr, "method=%s; ", req->method );
+		if( req->target != NULL )fprintf( stderr, "target=%s; ", req->target );
+		if( req->version != NULL )fprintf( stderr, "version=%s; ", req->version );
+		fprintf( stderr, ";\n" );
+		fprintf( stderr, "e = %d, state = %d, map = %ld;\n", req->e, req->state, (long)req->map ); // debug
+	}
+	__atomic_add_fetch( &stats.requests, 1, __ATOMIC_RELAXED ); // maybe on a pool thread, see conn_offload()
+	reset_response_headers( req );
+	if( req->e == 0 && req->state == WANT_BODY ){
+		if( req->map != NULL ){
+			if( verbosity >= 1 )fprintf( stderr, "catnip: trying action %s\n", req->map->method );
+			// body_length was worked out by parse_http_request()
+			// old method action took ( body_fd, req->body, req->nr - (p - req->buf) )
+			e = (*req->map->action)( req );
+			if( req->e != 0 && req->e != e ){ // a response header did not fit, see add_response_header(); send none of it
+				req->message = "Internal Server Error - headers"; // the action may have said OK since
+				if( req->doc_fd >= 0 )
+					release_doc( req->doc_fd, req->doc_meta );
+				req->doc_fd = -1;
+				// doc_meta stays: an entry a pool thread opened is conn_offloaded()'s to adopt
+				req->ranges = NULL;
+				req->boundary = NULL;
+				req->content_type = NULL;
+				req->deflating = req->chunked = 0;
+				req->body_pending = 0;
+				req->reply = NULL;
+				req->reply_length = 0;
+				req->keep_alive = 0;
+				reset_response_headers( req );
+			}
+			else
+				req->e = e;
+			if( verbosity >= 1 )fprintf( stderr, "catnip: back from action %s, e = %d\n", req->map->method, req->e );
+		}
+	}
+	else
+		req->keep_alive = 0; // lost our place in the stream
+	if( !req->allow_keep_alive )
+		req->keep_alive = 0;
+	if( req->e != 304 && find_response_header( req, "Content-Length" ) == NULL && find_response_header( req, "Transfer-Encoding" ) == NULL ){ // HEAD already said how long the GET would be
+		char lenbuf[32];
+		snprintf( lenbuf, sizeof( lenbuf ), "%lld", req->doc_fd >= 0 ? (long long)req->doc_length : (long long)req->reply_length );
+		add_response_header( req, "Content-Length", lenbuf );
+	}
+	add_response_header( req, "Connection", req->keep_alive ? "keep-alive" : "close" );
+}
+
+// no longer globals: each request carries its own, copied into its arena
+void reset_response_headers( struct http_request* req ){
+	req->response_headers = req->response_header_space;
+	req->response_header_cap = CATNIP_RESPONSE_HEADERS;
+	req->response_header_count = 0;
+}
+
+// a header that does not fit in the arena is left out, and the request becomes a 500, see dispatch_request()
+void add_response_header( struct http_request* req, char* key, char* value ){
+	struct key_value_pair* kvp;
+	if( req->response_header_count == req->response_header_cap ){ // no cap, just double into the arena
+		if( ( kvp = arena_alloc( &req->arena, 2 * req->response_header_cap * sizeof( struct key_value_pair ) ) ) == NULL ){
+			req->e = 500;
+			req->message = "Internal Server Error - headers";
+			return;
+		}
+		memcpy( kvp, req->response_headers, req->response_header_count * sizeof( struct key_value_pair ) );
+		req->response_headers = kvp;
+		req->response_header_cap *= 2;
+	}
+	kvp = &req->response_headers[req->response_header_count];
+	if( ( kvp->key = arena_strdup( &req->arena, key ) ) == NULL
+	 || ( kvp->value = arena_strdup( &req->arena, value ) ) == NULL ){
+		req->e = 500;
+		req->message = "Internal Server Error - headers";
+		return;
+	}
+	++req->response_header_count;
+}
+
+char* find_response_header( struct http_request* req, char* key ){
+	for( int i = 0; i < req->response_header_count; ++i ){
+		if( strcasecmp( req->response_headers[i].key, key ) == 0 )
+			return req->response_headers[i].value;
+	}
+	return NULL;
+}
+
+// set_response_header replaces the value of a header already added, else adds it
+void set_response_header( struct http_request* req, char* key, char* value ){
+	for( int i = 0; i < req->response_header_count; ++i ){
+		if( strcasecmp( req->response_headers[i].key, key ) == 0 ){
+			if( ( value = arena_strdup( &req->arena, value ) ) == NULL ){
+				req->e = 500;
+				req->message = "Internal Server Error - headers";
+				return;
+			}
+			req->response_headers[i].value = value;
+			return;
+		}
+	}
+	add_response_header( req, key, value );
+}
+
+// drop_response_header takes a header back out, if it was added
+void drop_response_header( struct http_request* req, char* key ){
+	for( int i = 0; i < req->response_header_count; ++i ){
+		if( strcasecmp( req->response_headers[i].key, key ) == 0 ){
+			--req->response_header_count;
+			memmove( &req->response_headers[i], &req->response_headers[i + 1], ( req->response_header_count - i ) * sizeof( struct key_value_pair ) );
+			return;
+		}
+	}
+}
+
+void write_response_headers( struct catnip_buffer* head, struct http_request* req ){
+	for( int i = 0; i < req->response_header_count; ++i ){
+		buffer_puts( head, req->response_headers[i].key );
+		buffer_append( head, ": ", 2 );
+		buffer_puts( head, req->response_headers[i].value );
+		buffer_append( head, "\r\n", 2 );
+	}
+}
+
+/*
+ * status_line finds the ready-made status line for the usual case: an
+ * HTTP/1.1 or 1.0 request whose action left the standard reason phrase
+ * (or none). anything else, say "Bad Request - null byte", gets NULL and
+ * write_http_response() pieces the line together.
+ */
+#define STATUS_LINES( code, reason ) \
+	case code: \
+		if( req->message != NULL && strcmp( req->message, reason ) != 0 ) \
+			return NULL; \
+		if( http10 ){ \
+			*len = sizeof( "HTTP/1.0 " #code " " reason "\r\n" ) - 1; \
+			return "HTTP/1.0 " #code " " reason "\r\n"; \
+		} \
+		*len = sizeof( "HTTP/1.1 " #code " " reason "\r\n" ) - 1; \
+		return "HTTP/1.1 " #code " " reason "\r\n";
+
+static const char*
+status_line( struct http_request* req, size_t* len )
+{
+	int http10;
+
+	if( req->version == NULL )
+		http10 = 0;
+	else if( req->vp != NULL && req->vp->http_version == HTTP_1_1 )
+		http10 = 0;
+	else if( req->vp != NULL && req->vp->http_version == HTTP_1_0 )
+		http10 = 1;
+	else
+		return NULL;
+	switch( req->e ){
+	CATNIP_STATUSES( STATUS_LINES )
+	}
+	return NULL;
+}
+
+/*
+ * date_line is the Date: header line for now, formatted again only when
+ * the second has changed; time() is a vDSO read, strftime() is not.
+ */
+static const char*
+date_line( size_t* len )
+{
+	static char line[64];
+	static size_t line_len;
+	static time_t when = -1;
+	time_t now = time( NULL );
+	struct tm tm;
+
+	if( now != when && gmtime_r( &now, &tm ) != NULL ){
+		line_len = strftime( line, sizeof( line ), "Date: %a, %d %b %Y %H:%M:%S GMT\r\n", &tm );
+		when = now;
+	}
+	*len = line_len;
+	return line;
+}
+
+// Write a response to the "header" channel - perhaps to be relayed by kc to nc:
+//
+// HTTP/1.1 200 Everything Is Just Fine
+// Server: netcat!
+// Content-Type: text/html; charset=UTF-8
+// (this line intentionally left blank)
+//
+// the head is assembled in a buffer; the caller decides whether it goes to
+// the head file or straight down a socket.
+static void
+write_http_response( struct catnip_buffer* head, struct http_request* req )
+{
+	static const char server[] = "Server: catnip (cn) 0.0.1\r\n";
+	const char* line;
+	size_t len;
+
+	if( ( line = status_line( req, &len ) ) != NULL )
+		buffer_append( head, line, len );
+	else
+		buffer_printf( head, "%s %d %s\r\n", req->version == NULL ? "HTTP/1.1" : req->version, req->e, req->message == NULL ? "nominal" : req->message );
+	buffer_append( head, server, sizeof( server ) - 1 );
+	line = date_line( &len );
+	buffer_append( head, line, len );
+	buffer_append( head, "Content-Type: ", 14 );
+	buffer_puts( head, req->content_type == NULL ? "text/html; charset=UTF-8" : req->content_type );
+	buffer_append( head, "\r\n", 2 );
+	// consider other headers too? which request headers should also be response headers?
+	// which additional headers should be added in? such as size? 
+	write_response_headers( head, req );
+	buffer_append( head, "\r\n", 2 ); // done with the headers, on to the body! (well, the end of this file, let kc cat them)
+}
+
+/*
+ * write_http_body emits whatever body the action staged into body_fd:
+ * a document via raw_cat, ranges of one via range_cat, or an in-memory reply.
+ */
+static int
+write_http_body( int body_fd, struct http_request* req )
+{
+	int e = 0;
+	if( req->doc_fd >= 0 && req->deflating ){
+		struct catnip_gzip* g;
+		int more;
+		if( ( g = gzip_start( req->doc_fd, req->doc_meta != NULL ? req->doc_meta->data : NULL, req->doc_length, req->doc_path ) ) == NULL )
+			err(1, "gzip");
+		while( e == 0 && ( more = gzip_next( g ) ) > 0 ){
+			struct catnip_buffer chunk = { g->chunk, g->chunk_len, 0, g->chunk_len };
+			e = buffer_flush( body_fd, &chunk );
+		}
+		if( e == 0 && more < 0 ){
+			warnx( "%s: gzip cut short", req->target );
+			e = 1;
+		}
+		gzip_free( g );
+		release_doc( req->doc_fd, req->doc_meta );
+		req->doc_fd = -1;
+	}
+	else if( req->doc_fd >= 0 && req->ranges != NULL ){
+		char part[512];
+		for( int i = 0; i <= req->range_count && e == 0; ++i ){
+			if( req->boundary != NULL ){
+				int len = range_part( req, i, part, sizeof( part ) );
+				struct catnip_buffer head = { part, len, 0, len };
+				e = buffer_flush( body_fd, &head );
+			}
+			if( i < req->range_count && e == 0 )
+				e = range_cat( req->target, req->doc_fd, body_fd, req->ranges[i].offset, req->ranges[i].length );
+		}
+		release_doc( req->doc_fd, req->doc_meta );
+		req->doc_fd = -1;
+	}
+	else if( req->doc_fd >= 0 ){
+		// inverting use of raw_cat - instead of going to stdout, we use it like cp would
+		e = raw_cat( req->target, req->doc_fd, body_fd );
+		release_doc( req->doc_fd, req->doc_meta );
+		req->doc_fd = -1;
+	}
+	else if( req->chunked ){
+		struct catnip_buffer reply = { NULL, 0, 0, 0 };
+		if( req->reply != NULL )
+			buffer_chunk( &reply, req->reply, req->reply_length );
+		if( req->body_pending == 0 )
+			buffer_append( &reply, CATNIP_LAST_CHUNK, sizeof( CATNIP_LAST_CHUNK ) - 1 );
+		e = buffer_flush( body_fd, &reply );
+		free( reply.data );
+	}
+	else if( req->reply != NULL && req->reply_length > 0 ){
+		struct catnip_buffer reply = { req->reply, req->reply_length, 0, req->reply_length };
+		e = buffer_flush( body_fd, &reply );
+	}
+	return e;
+}
+
+/*
+ * echo_http_body is the rest of a TRACE whose body was still coming in
+ * when it was answered (body_pending): read from rfd into the request
+ * buffer, written out as one chunk per read, then the last chunk. the
+ * head has been answered, so the whole buffer is the body's now; memory
+ * stays at that whatever the Content-Length. nonzero if either side fails,
+ * and then there is no last chunk, so the client can tell.
+ */
+static int
+echo_http_body( int rfd, int body_fd, struct http_request* req )
+{
+	struct catnip_buffer chunk = { NULL, 0, 0, 0 };
+	ssize_t n;
+	int e = 0;
+
+	while( e == 0 && req->body_pending > 0 ){
+		if( ( n = read( rfd, req->buf, req->body_pending < (off_t)req->bsize ? (size_t)req->body_pending : req->bsize ) ) < 0 && errno == EINTR )
+			continue;
+		if( n <= 0 ){
+			warnx( "%s: body cut short, %lld bytes to go", req->target, (long long)req->body_pending );
+			e = 1;
+			break;
+		}
+		req->body_pending -= n;
+		chunk.len = chunk.off = 0;
+		buffer_chunk( &chunk, req->buf, n );
+		if( req->body_pending == 0 )
+			buffer_append( &chunk, CATNIP_LAST_CHUNK, sizeof( CATNIP_LAST_CHUNK ) - 1 );
+		e = buffer_flush( body_fd, &chunk );
+	}
+	free( chunk.data );
+	return e;
+}
+
+static void
+buffer_reserve( struct catnip_buffer* b, size_t more )
+{
+	if( b->len + more > b->cap ){
+		size_t cap = b->cap ? b->cap : 256;
+		while( cap < b->len + more )
+			cap *= 2;
+		if( ( b->data = catnip_realloc( b->data, cap ) ) == NULL )
+			err(1, "buffer");
+		b->cap = cap;
+	}
+}
+
+static void
+buffer_append( struct catnip_buffer* b, const void* data, size_t len )
+{
+	buffer_reserve( b, len );
+	memcpy( b->data + b->len, data, len );
+	b->len += len;
+}
+
+static void
+buffer_puts( struct catnip_buffer* b, const char* s )
+{
+	buffer_append( b, s, strlen( s ) );
+}
+
+/*
+ * buffer_chunk appends len bytes as one chunk of a chunked body (RFC 9112
+ * 7.1): the size in hex, CRLF, the bytes, CRLF. nothing at all for none,
+ * as a chunk of size 0 is the last one, CATNIP_LAST_CHUNK.
+ */
+static void
+buffer_chunk( struct catnip_buffer* b, const void* data, size_t len )
+{
+	if( len == 0 )
+		return;
+	buffer_printf( b, "%zx\r\n", len );
+	buffer_append( b, data, len );
+	buffer_append( b, "\r\n", 2 );
+}
+
+static void
+buffer_printf( struct catnip_buffer* b, const char* fmt, ... )
+{
+	va_list ap;
+	int n;
+
+	buffer_reserve( b, 128 );
+	va_start( ap, fmt );
+	n = vsnprintf( b->data + b->len, b->cap - b->len, fmt, ap );
+	va_end( ap );
+	if( n >= 0 && (size_t)n >= b->cap - b->len ){
+		buffer_reserve( b, n + 1 );
+		va_start( ap, fmt );
+		n = vsnprintf( b->data + b->len, b->cap - b->len, fmt, ap );
+		va_end( ap );
+	}
+	if( n > 0 )
+		b->len += n;
+}
+
+/*
+ * buffer_flush writes out what is left of the buffer, blocking as needed.
+ */
+static int
+buffer_flush( int fd, struct catnip_buffer* b )
+{
+	ssize_t nw;
+	while( b->off < b->len ){
+		if( ( nw = write( fd, b->data + b->off, b->len - b->off ) ) < 0 ){
+			if( errno == EINTR )
+				continue;
+			warn( "write" );
+			return 1;
+		}
+		b->off += nw;
+	}
+	return 0;
+}
+
+/*
+ * if we are running in fork/chroot mode, then we can just use our webroot 
  * as the chroot path, such as "kitty" which should just be effectively 
  * "./kitty" as a relative path to the present working directory from
  * which we (cn) were run. certainly, if we are running in-process without
@@ -609,18 +1718,44 @@ write_http_response( int head_fd, char* version, int status, char* message, char
  * which all begs the question, are we (wrangle_path) responsible for
  * vetting the paths with stat and such or do we just leave that to the 
  * action methods themselves?
+ *
+ * the stat and such, no; but the ../ tricks, yes, here and nowhere else,
+ * since the pipeline, both listener backends and the pool threads all
+ * come through here: a target that is not absolute, or has a .. segment
+ * anywhere, gets a 400 and a NULL before any path is built. (nothing is
+ * percent-decoded, so %2e%2e is only a name; the parser refuses NUL bytes.)
  */
+static int
+target_escapes( char* target )
+{
+	char* p;
+
+	if( target == NULL || target[0] != '/' )
+		return 1;
+	for( p = target; ( p = strstr( p, ".." ) ) != NULL; p += 2 )
+		if( p[-1] == '/' && ( p[2] == '/' || p[2] == '\0' ) )
+			return 1;
+	return 0;
+}
+
 char* wrangle_path( struct http_request* req ){
 	char* herded_path = NULL;
 	char* default_doc = "index.html"; // should really be a parameter
-	// length of / (1) --> kitty/index.html\0 (17)
-	int   effective_length = strlen( req->webroot ) + strlen( req->target ) + strlen( default_doc ) + 2; // has margin if not default_doc...
+	int   effective_length;
 	if( verbosity >= 1 )fprintf( stderr, "into wrangle: target=%s\n", req->target );
-	if( ( herded_path = malloc( effective_length ) ) == NULL ){
+	if( target_escapes( req->target ) ){
+		req->e = 400;
+		req->message = "Bad Request - path";
+		return NULL;
+	}
+	// length of / (1) --> kitty/index.html\0 (17)
+	effective_length = strlen( req->webroot ) + strlen( req->target ) + strlen( default_doc ) + 2; // has margin if not default_doc...
+	if( ( herded_path = arena_alloc( &req->arena, effective_length ) ) == NULL ){ // freed with the request
 		req->e = 500; // not enough memory for path
 	}
 	else{
 		char* p;
+		herded_path[0] = '\0';
 		if( !req->usefork )
 			strcpy( herded_path, req->webroot );
 		strcat( herded_path, req->target );
@@ -636,6 +1771,9 @@ char* wrangle_path( struct http_request* req ){
  * raw_cat() brought in from cat.c via kittycat.c 2022-01-24
  * but now we're making it more like cp since we're taking both rfd and wfd 
  * in and not assuming wfd = fileno(stdout) as the inherited one had done in cat.
+ *
+ * and like cp, we first ask the kernel to do the copy for us (raw_cat_kernel),
+ * only falling back to the read/write loop when it declines.
  */
 static int
 raw_cat(char* filename, int rfd, int wfd) // are you a copy *of* a cat or are you a cp *for* a cat? 
@@ -647,11 +1785,19 @@ raw_cat(char* filename, int rfd, int wfd) // are you a copy *of* a cat or are yo
 	struct stat sbuf;
 	int rval = 0;
 
+	switch( raw_cat_kernel( filename, rfd, wfd ) ){
+	case 0:
+		return 0; // the kernel did it all
+	case 1:
+		break; // declined (or stopped part way), the loop picks up at the current offsets
+	default:
+		return 1; // warned already
+	}
 	if (buf == NULL) {
 		if (fstat(wfd, &sbuf))
 			err(1, "%s", filename);
 		bsize = sbuf.st_blksize > 1024 ? sbuf.st_blksize : 1024; // old school instead of MAX
-		if ((buf = malloc(bsize)) == NULL)
+		if ((buf = catnip_malloc(bsize)) == NULL)
 			err(1, "buffer");
 	}
 	while ((nr = read(rfd, buf, bsize)) > 0)
@@ -665,21 +1811,359 @@ raw_cat(char* filename, int rfd, int wfd) // are you a copy *of* a cat or are yo
 	return rval;
 }
 
-int http_trace( int body_fd, struct http_request* req ){
-	write( body_fd, req->body, req->body_length ); // that's all she wrote
+/*
+ * range_cat copies length bytes of rfd from offset on, for a 206. the
+ * kernel copies take the offset by pointer, so rfd's own is left alone
+ * (it may be the cache's, shared); pread() picks up whatever they decline.
+ */
+static int
+range_cat( char* filename, int rfd, int wfd, off_t offset, off_t length )
+{
+	static char buf[65536];
+	ssize_t n, nw;
+	size_t off;
+#ifdef __linux__
+	struct stat wstat;
+
+	if( fstat( wfd, &wstat ) == 0 && S_ISREG( wstat.st_mode ) )
+		while( length > 0 && ( n = copy_file_range( rfd, &offset, wfd, NULL, length, 0 ) ) > 0 )
+			length -= n;
+	while( length > 0 && ( n = sendfile( wfd, rfd, &offset, length ) ) > 0 )
+		length -= n;
+#endif
+	while( length > 0 ){
+		if( ( n = pread( rfd, buf, length < (off_t)sizeof( buf ) ? (size_t)length : sizeof( buf ), offset ) ) <= 0 ){
+			if( n < 0 && errno == EINTR )
+				continue;
+			if( n < 0 )
+				warn( "%s", filename );
+			else
+				warnx( "%s: shrank under us", filename );
+			return 1;
+		}
+		for( off = 0; off < (size_t)n; off += nw )
+			if( ( nw = write( wfd, buf + off, n - off ) ) < 0 )
+				err(1, "body");
+		offset += n;
+		length -= n;
+	}
+	return 0;
+}
+
+/*
+ * the variant cache: bodies gzip_next() made, by (path, mtime, encoding),
+ * so only the first request for a version of a document pays for deflate.
+ * an entry for an older mtime is never found again and ages out of the
+ * LRU, or goes when a newer one for the path comes in; -Z bounds the
+ * bytes. pool threads look here too, hence the lock.
+ */
+#define CATNIP_ZCACHE_BUCKETS 256 // power of two
+
+static pthread_mutex_t zcache_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct catnip_zvar* zcache_buckets[CATNIP_ZCACHE_BUCKETS];
+static struct catnip_zvar *zcache_mru, *zcache_lru;
+
+// zcache_find takes a reference on the body for path as of mtime, or returns NULL
+static struct catnip_zvar*
+zcache_find( char* path, struct timespec* mtime, const char* encoding )
+{
+	unsigned hash = catnip_hash( path, strlen( path ), 0, 0 );
+	struct catnip_zvar* z;
+
+	pthread_mutex_lock( &zcache_lock );
+	for( z = zcache_buckets[hash & (CATNIP_ZCACHE_BUCKETS - 1)]; z != NULL; z = z->hnext )
+		if( z->hash == hash && z->encoding == encoding && z->mtime.tv_sec == mtime->tv_sec
+		 && z->mtime.tv_nsec == mtime->tv_nsec && strcmp( z->path, path ) == 0 )
+			break;
+	if( z != NULL ){
+		if( z != zcache_mru ){ // to the front
+			z->prev->next = z->next;
+			if( z->next != NULL )
+				z->next->prev = z->prev;
+			else
+				zcache_lru = z->prev;
+			z->prev = NULL;
+			z->next = zcache_mru;
+			zcache_mru->prev = z;
+			zcache_mru = z;
+		}
+		++z->refs;
+		++stats.zcache_hits;
+	}
+	pthread_mutex_unlock( &zcache_lock );
+	return z;
+}
+
+// zcache_drop, with the lock held: out of the cache, freed once no response is sending it
+static void
+zcache_drop( struct catnip_zvar* z )
+{
+	struct catnip_zvar** pp;
+
+	for( pp = &zcache_buckets[z->hash & (CATNIP_ZCACHE_BUCKETS - 1)]; *pp != z; pp = &(*pp)->hnext )
+		;
+	*pp = z->hnext;
+	if( z->prev != NULL )
+		z->prev->next = z->next;
+	else
+		zcache_mru = z->next;
+	if( z->next != NULL )
+		z->next->prev = z->prev;
+	else
+		zcache_lru = z->prev;
+	stats.zcache_bytes -= z->len;
+	if( --z->refs == 0 ){
+		free( z->data );
+		free( z );
+	}
+}
+
+static void
+zcache_release( struct catnip_zvar* z )
+{
+	int refs;
+
+	pthread_mutex_lock( &zcache_lock );
+	refs = --z->refs;
+	pthread_mutex_unlock( &zcache_lock );
+	if( refs == 0 ){
+		free( z->data );
+		free( z );
+	}
+}
+
+// zcache_insert keeps data (ours now, len bytes) as path's body as of mtime, making room under -Z
+static void
+zcache_insert( char* path, struct timespec* mtime, const char* encoding, char* data, size_t len )
+{
+	size_t plen = strlen( path );
+	struct catnip_zvar *z, *old, *next;
+
+	if( len > zcache_budget || ( z = catnip_calloc( 1, sizeof( struct catnip_zvar ) + plen + 1 ) ) == NULL ){
+		free( data );
+		return;
+	}
+	z->path = memcpy( (char*)( z + 1 ), path, plen + 1 );
+	z->hash = catnip_hash( path, plen, 0, 0 );
+	z->mtime = *mtime;
+	z->encoding = encoding;
+	z->data = data;
+	z->len = len;
+	z->refs = 1; // the cache's own
+	pthread_mutex_lock( &zcache_lock );
+	for( old = zcache_buckets[z->hash & (CATNIP_ZCACHE_BUCKETS - 1)]; old != NULL; old = next ){
+		next = old->hnext; // another version of it, or the same one from a stream that ran alongside
+		if( old->hash == z->hash && old->encoding == encoding && strcmp( old->path, path ) == 0 )
+			zcache_drop( old );
+	}
+	while( zcache_lru != NULL && stats.zcache_bytes + len > zcache_budget ){
+		++stats.zcache_evictions;
+		zcache_drop( zcache_lru );
+	}
+	z->hnext = zcache_buckets[z->hash & (CATNIP_ZCACHE_BUCKETS - 1)];
+	zcache_buckets[z->hash & (CATNIP_ZCACHE_BUCKETS - 1)] = z;
+	if( ( z->next = zcache_mru ) != NULL )
+		zcache_mru->prev = z;
+	else
+		zcache_lru = z;
+	zcache_mru = z;
+	stats.zcache_bytes += len;
+	pthread_mutex_unlock( &zcache_lock );
+}
+
+static struct catnip_gzip*
+gzip_start( int fd, const char* data, off_t length, char* key )
+{
+	struct catnip_gzip* g;
+	struct stat st;
+
+	if( ( g = catnip_calloc( 1, sizeof( struct catnip_gzip ) ) ) == NULL )
+		return NULL;
+	if( deflateInit2( &g->z, gzip_level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY ) != Z_OK ){ // +16: a gzip wrapper, not zlib's
+		free( g );
+		return NULL;
+	}
+	g->fd = fd;
+	g->data = data;
+	g->remaining = length;
+	if( key != NULL && fstat( fd, &st ) == 0 && ( g->key = strdup( key ) ) != NULL )
+		g->mtime = st.st_mtim;
+	__atomic_add_fetch( &stats.gzip_streams, 1, __ATOMIC_RELAXED );
+	return g;
+}
+
+// gzip_next frames the next chunk in g->chunk; returns 1, 0 once the last has been, or -1 when the read failed
+static int
+gzip_next( struct catnip_gzip* g )
+{
+	z_stream* z = &g->z;
+	char head[CATNIP_CHUNK_HEAD + 1];
+	struct stat st;
+	size_t len;
+	ssize_t n;
+	int res;
+
+	if( g->finished )
+		return 0;
+	z->next_out = (Bytef*)g->out + CATNIP_CHUNK_HEAD;
+	z->avail_out = CATNIP_GZIP_CHUNK;
+	do{
+		if( z->avail_in == 0 && g->remaining > 0 ){
+			if( g->data != NULL ){
+				z->next_in = (Bytef*)g->data + g->offset;
+				n = g->remaining < ( 1 << 30 ) ? g->remaining : ( 1 << 30 );
+			}
+			else if( ( n = pread( g->fd, g->in, g->remaining < (off_t)sizeof( g->in ) ? (size_t)g->remaining : sizeof( g->in ), g->offset ) ) > 0 )
+				z->next_in = (Bytef*)g->in;
+			else if( n < 0 && errno == EINTR )
+				continue;
+			else{
+				g->finished = 1; // shrank under us, or worse; no last chunk, the client can tell
+				return -1;
+			}
+			z->avail_in = n;
+			g->offset += n;
+			g->remaining -= n;
+		}
+		if( ( res = deflate( z, g->remaining == 0 ? Z_FINISH : Z_NO_FLUSH ) ) == Z_STREAM_END )
+			g->finished = 1;
+		else if( res != Z_OK && res != Z_BUF_ERROR ){
+			g->finished = 1;
+			return -1;
+		}
+	}while( z->avail_out > 0 && !g->finished );
+	len = CATNIP_GZIP_CHUNK - z->avail_out;
+	n = snprintf( head, sizeof( head ), "%zx\r\n", len );
+	g->chunk = g->out + CATNIP_CHUNK_HEAD - n;
+	memcpy( g->chunk, head, n );
+	if( len == 0 ) // only ever the end, as a chunk of its own
+		memcpy( g->chunk + n, "\r\n", 2 );
+	else
+		memcpy( g->out + CATNIP_CHUNK_HEAD + len, "\r\n" CATNIP_LAST_CHUNK, g->finished ? 7 : 2 );
+	g->chunk_len = n + len + ( len == 0 ? 2 : g->finished ? 7 : 2 );
+	if( g->key != NULL && g->keep.len + len > content_max ){ // too big to keep, send it and forget it
+		free( g->keep.data );
+		memset( &g->keep, 0, sizeof( g->keep ) );
+		free( g->key );
+		g->key = NULL;
+	}
+	else if( g->key != NULL )
+		buffer_append( &g->keep, g->out + CATNIP_CHUNK_HEAD, len );
+	if( g->finished && g->key != NULL && fstat( g->fd, &st ) == 0
+	 && st.st_mtim.tv_sec == g->mtime.tv_sec && st.st_mtim.tv_nsec == g->mtime.tv_nsec ){ // unchanged while we read it
+		zcache_insert( g->key, &g->mtime, "gzip", g->keep.data, g->keep.len );
+		memset( &g->keep, 0, sizeof( g->keep ) );
+	}
+	return 1;
+}
+
+static void
+gzip_free( struct catnip_gzip* g )
+{
+	deflateEnd( &g->z );
+	free( g->keep.data );
+	free( g->key );
+	free( g );
+}
+
+/*
+ * raw_cat_kernel tries, in order of cheapness:
+ *	FICLONE		reflink the whole document (btrfs, xfs, ...) while the body is still empty
+ *	copy_file_range	in-kernel (or server-side) copy between regular files
+ *	sendfile	in-kernel copy to anything else we may be handed
+ * returns 0 when the document has been fully copied, 1 when the caller should
+ * carry on with its own loop, and -1 on a real error (already warned).
+ */
+static int
+raw_cat_kernel(char* filename, int rfd, int wfd)
+{
+#ifdef __linux__
+	struct stat rstat, wstat;
+	ssize_t n;
+
+	if( fstat( rfd, &rstat ) || fstat( wfd, &wstat ) || !S_ISREG( rstat.st_mode ) )
+		return 1;
+	if( S_ISREG( wstat.st_mode ) && wstat.st_size == 0 && lseek( wfd, 0, SEEK_CUR ) == 0 && lseek( rfd, 0, SEEK_CUR ) == 0 ){
+		if( ioctl( wfd, FICLONE, rfd ) == 0 ){
+			if( verbosity >= 1 )fprintf( stderr, "catnip: %s reflinked\n", filename );
+			lseek( wfd, 0, SEEK_END ); // as if we had written it all
+			return 0;
+		}
+	}
+	if( S_ISREG( wstat.st_mode ) ){
+		while( ( n = copy_file_range( rfd, NULL, wfd, NULL, 1 << 30, 0 ) ) > 0 )
+			;
+		if( n == 0 ){
+			if( verbosity >= 1 )fprintf( stderr, "catnip: %s copied by copy_file_range\n", filename );
+			return 0;
+		}
+		if( errno != EXDEV && errno != EINVAL && errno != ENOSYS && errno != EOPNOTSUPP && errno != EBADF ){
+			warn( "%s", filename );
+			return -1;
+		}
+	}
+	while( ( n = sendfile( wfd, rfd, NULL, 1 << 30 ) ) > 0 )
+		;
+	if( n == 0 ){
+		if( verbosity >= 1 )fprintf( stderr, "catnip: %s copied by sendfile\n", filename );
+		return 0;
+	}
+	if( errno == EINVAL || errno == ENOSYS )
+		return 1;
+	warn( "%s", filename );
+	return -1;
+#else
+	return 1;
+#endif
+}
+
+int http_trace( struct http_request* req ){
+	req->reply = req->body; // that's all she wrote
+	req->reply_length = req->body_length;
+	if( req->body_pending > 0 ){ // or all she has written so far, see echo_http_body() and conn_echo()
+		add_response_header( req, "Transfer-Encoding", "chunked" );
+		req->chunked = 1;
+	}
 	req->message = "OK";
 	return 200;
 }
 
-int http_head( int body_fd, struct http_request* req ){
+int http_head( struct http_request* req ){
 	// there is no body, only head
 	int e;
 	char* path;
 	struct stat docstat;
 	struct tm   tm, *resulttm;
 	char statbuf[64]; // temporary number to string conversion
-	path = wrangle_path( req );
-	switch( e = access( path, F_OK|R_OK ) ){
+	struct catnip_meta* meta;
+	unsigned have;
+	int i;
+	char* etag;
+	if( ( path = wrangle_path( req ) ) == NULL )
+		return req->e; // 400 or 500, and why
+	if( ( meta = meta_lookup( path ) ) != NULL ){ // the listener has seen it before, or just opened it
+		for( have = 0, i = 0; i < CATNIP_ENCODINGS; ++i )
+			if( meta->variant[i] != NULL )
+				have |= 1u << i;
+		if( ( i = http_encoding( req, have ) ) >= 0 )
+			meta = meta->variant[i]; // describe and send that instead, meta->parent is what the cache holds
+		add_response_header( req, "Content-Length", meta->content_length );
+		add_response_header( req, "Accept-Ranges", "bytes" );
+		if( meta->last_modified[0] )
+			add_response_header( req, "Last-Modified", meta->last_modified );
+		add_response_header( req, "ETag", meta->etag );
+		etag = i < 0 ? http_gzip( req, meta->path, &meta->st, meta->etag ) : meta->etag;
+		req->doc_meta = meta; // for http_get(), no reference taken yet
+		req->message = "OK";
+		return http_conditional( req, etag, meta->st.st_mtim.tv_sec );
+	}
+	if( req->doc_errno ){ // the ring has tried, see uring_looked()
+		errno = req->doc_errno;
+		e = -1;
+	}
+	else
+		e = access( path, F_OK|R_OK );
+	switch( e ){
 	case 0:
 		break;
 	case -1:
@@ -698,16 +2182,45 @@ int http_head( int body_fd, struct http_request* req ){
 	}
 	switch( e = stat( path, &docstat ) ){
 	case 0:
-		sprintf( statbuf, "%ld", docstat.st_size ); // or %lld for macos and amazon linux
-		add_response_header( "Content-Length", statbuf ); // that will copy, we can reuse statbuf
+		{ // the siblings, looked for even without an Accept-Encoding, for Vary
+			struct stat sibstat[CATNIP_ENCODINGS];
+			char* sibling[CATNIP_ENCODINGS];
+			for( have = 0, i = 0; i < CATNIP_ENCODINGS; ++i ){
+				if( ( sibling[i] = arena_alloc( &req->arena, strlen( path ) + strlen( catnip_encodings[i].suffix ) + 1 ) ) == NULL )
+					continue; // and go without
+				strcat( strcpy( sibling[i], path ), catnip_encodings[i].suffix );
+				if( stat( sibling[i], &sibstat[i] ) == 0 && sibling_fresh( &docstat, &sibstat[i] ) )
+					have |= 1u << i;
+			}
+			if( ( i = http_encoding( req, have ) ) >= 0 ){
+				path = sibling[i];
+				docstat = sibstat[i];
+			}
+		}
+		req->doc_path = path; // for http_get()
+		sprintf( statbuf, "%lld", (long long)docstat.st_size ); // off_t is 64 bits everywhere we build, long is not
+		add_response_header( req, "Content-Length", statbuf ); // that will copy, we can reuse statbuf
+		add_response_header( req, "Accept-Ranges", "bytes" ); // see http_range()
 		resulttm = gmtime_r( &docstat.st_mtim.tv_sec, &tm );
 		if( resulttm != NULL ){
 			int l;
 			l = strftime( statbuf, 64, "%a, %d %b %Y %H:%M:%S %Z", &tm );
 			if( l ){
-				add_response_header( "Date", statbuf );
+				add_response_header( req, "Last-Modified", statbuf ); // Date is when we answer, see date_line()
 			}
 		}
+		if( etag_hash ){
+			int fd = open( path, O_RDONLY );
+			doc_etag( statbuf, sizeof( statbuf ), &docstat, fd );
+			if( fd >= 0 )
+				close( fd );
+		}
+		else
+			doc_etag( statbuf, sizeof( statbuf ), &docstat, -1 );
+		add_response_header( req, "ETag", statbuf );
+		etag = i < 0 ? http_gzip( req, path, &docstat, statbuf ) : statbuf;
+		if( http_conditional( req, etag, docstat.st_mtim.tv_sec ) == 304 )
+			return 304;
 		// want other headers? 
 		// what about content type - a *simple* suffix to type assumption table?
 		if( verbosity >= 1 )fprintf( stderr, "HEAD got okay stat.\n" );
@@ -728,19 +2241,31 @@ int http_head( int body_fd, struct http_request* req ){
 	return 200;
 }
 
-int http_get( int body_fd, struct http_request* req ){
+int http_get( struct http_request* req ){
 	int e;
 	char* path;
 	int doc_fd;
-	switch( e = http_head( body_fd, req ) ){
+	switch( e = http_head( req ) ){
 	/* case 403: */
 	/* case 404: */
 	/* case 500: */
 	default: // all of the above
 		return e;
 	case 200:
-		// had already done this in http_head(), can we borrow? (e.g. stash in req before relayed back to us)
-		path = wrangle_path( req ); 
+		if( req->zvar != NULL ){ // gzipped already, see http_gzip()
+			req->reply = req->zvar->data;
+			req->reply_length = req->zvar->len;
+			break;
+		}
+		if( req->doc_meta != NULL ){ // http_head() found it in the cache, fd and all
+			req->doc_fd = req->doc_meta->fd;
+			req->doc_length = req->doc_meta->st.st_size;
+			++req->doc_meta->refs;
+			if( req->doc_meta->parent == NULL ) // variants go by sendfile, they are small and not in the cache's accounts
+				meta_content( req->doc_meta ); // keep a hot one in memory
+			return http_range( req );
+		}
+		path = req->doc_path != NULL ? req->doc_path : wrangle_path( req ); // http_head() chose among the siblings, and vetted it
 		doc_fd = open( path, O_RDONLY );
 		if( doc_fd < 0 ){
 			// why, when http_head cleared it? 
@@ -751,44 +2276,2564 @@ int http_get( int body_fd, struct http_request* req ){
 		else{
 			// now would be the time to check usefork and do the fork()/chroot() here
 			// alas, not yet...
-			// inverting use of raw_cat - instead of going to stdout, we use it like cp would
-			if( raw_cat( path, doc_fd, body_fd ) ){  // or want req->target instead of path?
-				req->message = "Internal Server Error - raw_cat"; // distinguish it
+			// stage the document; write_http_body() (or the listener) copies it once the head is out
+			struct stat docstat;
+			if( fstat( doc_fd, &docstat ) ){
+				req->message = "Internal Server Error - fstat"; // distinguish it
 				e = 500;
+				close( doc_fd );
+			}
+			else{
+				req->doc_fd = doc_fd;
+				req->doc_length = docstat.st_size;
+				e = http_range( req );
 			}
-			close( doc_fd );
 		}
 	}
 	return e;
 }
 
-int http_post( int body_fd, struct http_request* req ){
-	req->message = "Not Implemented";
-	return 501; // not implemented
-}
+/*
+ * http_range narrows a GET whose document is staged to what a Range header
+ * asks for: one range is a 206 with a Content-Range, several a 206 with a
+ * multipart/byteranges body, each part with a head of its own (see
+ * range_part()). an If-Range has to be the ETag or Last-Modified we would send, or
+ * the whole document goes out as a 200. a Range we cannot parse, or in
+ * some unit other than bytes, is ignored the same way; one that parses
+ * but lies wholly past the end is a 416. offsets are off_t all the way,
+ * so a document past 2GB (or 4GB) is no different.
+ */
+#define CATNIP_RANGES_MAX 16 // asking for more gets the whole document, no overlap games
 
-int http_patch( int body_fd, struct http_request* req ){
-	req->message = "Not Implemented";
+static int
+http_range( struct http_request* req )
+{
+	static unsigned long boundaries; // with the pid and time, a boundary no document will contain
+	struct catnip_range* r;
+	off_t size = req->doc_length, first, last, total;
+	char *p, *ep, *lm, buf[512];
+	char *boundary = NULL, *type = NULL;
+	int i, n = 0;
+
+	if( ( p = req->headers[HEADER_RANGE] ) == NULL )
+		return 200;
+	if( req->headers[HEADER_IF_RANGE] != NULL // an entity tag (compared strongly, so never a W/ one) or a date
+	 && ( ( lm = find_response_header( req, req->headers[HEADER_IF_RANGE][0] == '"' ? "ETag" : "Last-Modified" ) ) == NULL
+	   || strcmp( req->headers[HEADER_IF_RANGE], lm ) != 0 ) )
+		return 200; // changed since
+	if( strncasecmp( p, "bytes=", 6 ) != 0 )
+		return 200;
+	if( ( r = arena_alloc( &req->arena, CATNIP_RANGES_MAX * sizeof( struct catnip_range ) ) ) == NULL )
+		return 200; // the whole thing will do
+	for( p += 6; ; ++p ){
+		while( *p == ' ' || *p == '\t' )
+			++p;
+		errno = 0;
+		if( *p == '-' && isdigit( (unsigned char)p[1] ) ){ // the last so many bytes
+			last = strtoll( p + 1, &ep, 10 );
+			if( errno )
+				return 200;
+			first = last < size ? size - last : 0;
+			last = last > 0 ? size - 1 : -1; // -0 is nothing at all
+		}
+		else if( isdigit( (unsigned char)*p ) ){
+			first = strtoll( p, &ep, 10 );
+			if( errno || *ep != '-' )
+				return 200;
+			p = ep + 1;
+			if( isdigit( (unsigned char)*p ) ){
+				last = strtoll( p, &ep, 10 );
+				if( errno || last < first )
+					return 200;
+				if( last >= size )
+					last = size - 1;
+			}
+			else{
+				last = size - 1;
+				ep = p;
+			}
+		}
+		else
+			return 200;
+		if( first <= last ){ // else unsatisfiable, the others may still be
+			if( n == CATNIP_RANGES_MAX )
+				return 200;
+			r[n].offset = first;
+			r[n].length = last - first + 1;
+			++n;
+		}
+		for( p = ep; *p == ' ' || *p == '\t'; ++p )
+			;
+		if( *p == '\0' )
+			break;
+		if( *p != ',' )
+			return 200;
+	}
+	if( n == 0 ){
+		snprintf( buf, sizeof( buf ), "bytes */%lld", (long long)size );
+		add_response_header( req, "Content-Range", buf );
+		set_response_header( req, "Content-Length", "0" );
+		release_doc( req->doc_fd, req->doc_meta );
+		req->doc_fd = -1;
+		req->message = "Range Not Satisfiable";
+		return 416;
+	}
+	if( n > 1 ){ // both in the arena before anything changes, or the whole thing will do
+		snprintf( buf, sizeof( buf ), "catnip-%lx-%lx-%lu", (unsigned long)getpid(), (unsigned long)time( NULL ), __atomic_add_fetch( &boundaries, 1, __ATOMIC_RELAXED ) );
+		if( ( boundary = arena_strdup( &req->arena, buf ) ) == NULL )
+			return 200;
+		snprintf( buf, sizeof( buf ), "multipart/byteranges; boundary=%s", boundary );
+		if( ( type = arena_strdup( &req->arena, buf ) ) == NULL )
+			return 200;
+	}
+	req->ranges = r;
+	req->range_count = n;
+	if( n == 1 ){
+		snprintf( buf, sizeof( buf ), "bytes %lld-%lld/%lld", (long long)r[0].offset, (long long)( r[0].offset + r[0].length - 1 ), (long long)size );
+		add_response_header( req, "Content-Range", buf );
+		total = r[0].length;
+	}
+	else{
+		req->boundary = boundary;
+		req->range_type = req->content_type == NULL ? "text/html; charset=UTF-8" : req->content_type;
+		req->content_type = type;
+		for( total = 0, i = 0; i <= n; ++i )
+			total += range_part( req, i, buf, sizeof( buf ) ) + ( i < n ? r[i].length : 0 );
+	}
+	snprintf( buf, sizeof( buf ), "%lld", (long long)total );
+	set_response_header( req, "Content-Length", buf );
+	req->message = "Partial Content";
+	return 206;
+}
+
+/*
+ * http_conditional answers a GET or HEAD whose validators the client
+ * already holds with 304 Not Modified, before anything is opened, let alone
+ * copied. If-None-Match beats If-Modified-Since when both come (RFC 9110
+ * 13.2.2); tags compare weakly there, so W/"x" matches our "x", and * any
+ * document at all. returns 304, or 200 to carry on.
+ */
+static int
+http_conditional( struct http_request* req, char* etag, time_t mtime )
+{
+	char *p = req->headers[HEADER_IF_NONE_MATCH], *ep;
+	size_t len = strlen( etag );
+	struct tm tm;
+
+	if( p != NULL ){
+		for( ; ; ++p ){
+			while( *p == ' ' || *p == '\t' )
+				++p;
+			if( *p == '*' )
+				break;
+			if( strncmp( p, "W/", 2 ) == 0 )
+				p += 2;
+			if( strncmp( p, etag, len ) == 0 && ( p[len] == '\0' || p[len] == ',' || p[len] == ' ' || p[len] == '\t' ) )
+				break;
+			if( ( p = strchr( p, ',' ) ) == NULL )
+				return 200;
+		}
+	}
+	else if( ( p = req->headers[HEADER_IF_MODIFIED_SINCE] ) != NULL ){
+		memset( &tm, 0, sizeof( tm ) );
+		if( ( ep = strptime( p, "%a, %d %b %Y %H:%M:%S GMT", &tm ) ) == NULL || *ep != '\0' || timegm( &tm ) < mtime )
+			return 200; // not a date we can read, or changed since
+	}
+	else
+		return 200;
+	if( req->deflating || req->zvar != NULL ){ // http_gzip() had it going out gzipped: the -gzip tag stands, the body's headers go
+		drop_response_header( req, "Transfer-Encoding" );
+		drop_response_header( req, "Content-Encoding" );
+		drop_response_header( req, "Content-Length" ); // of the gzipped body, or of the document it no longer is
+		req->deflating = 0;
+		if( req->zvar != NULL )
+			zcache_release( req->zvar );
+		req->zvar = NULL;
+	}
+	__atomic_add_fetch( &stats.not_modified, 1, __ATOMIC_RELAXED );
+	req->message = "Not Modified";
+	return 304;
+}
+
+/*
+ * http_gzip decides whether a document goes out gzipped on the fly (-z):
+ * one of gzip_types[], at least CATNIP_GZIP_MIN bytes, to a client that
+ * takes gzip and asked for no Range (that would be of the gzip stream).
+ * Vary goes out for any such document, gzipped or not. a body the variant
+ * cache has goes from there, with its Content-Length; otherwise a GET
+ * gzips doc_fd a chunk at a time, chunked, for an HTTP/1.1 client, and a
+ * 1.0 one gets the document as it is. returns the ETag to go by, the
+ * document's with -gzip inside the quotes when it is gzipped.
+ */
+static char*
+http_gzip( struct http_request* req, char* path, struct stat* st, char* etag )
+{
+	char *dot = strrchr( path, '.' ), *p, tag[96];
+	int i;
+
+	if( gzip_level == 0 || st->st_size < CATNIP_GZIP_MIN || dot == NULL || strchr( dot, '/' ) != NULL )
+		return etag;
+	for( i = 0; gzip_types[i] != NULL && strcasecmp( dot, gzip_types[i] ) != 0; ++i )
+		;
+	if( gzip_types[i] == NULL )
+		return etag;
+	set_response_header( req, "Vary", "Accept-Encoding" ); // http_encoding() may have said so already
+	if( req->headers[HEADER_RANGE] != NULL || req->headers[HEADER_ACCEPT_ENCODING] == NULL
+	 || !encoding_accepted( req->headers[HEADER_ACCEPT_ENCODING], "gzip" ) )
+		return etag;
+	if( ( req->zvar = zcache_find( path, &st->st_mtim, "gzip" ) ) != NULL ){
+		snprintf( tag, sizeof( tag ), "%zu", req->zvar->len );
+		set_response_header( req, "Content-Length", tag );
+	}
+	else if( req->vp == NULL || req->vp->http_version != HTTP_1_1 )
+		return etag;
+	else{
+		drop_response_header( req, "Content-Length" );
+		add_response_header( req, "Transfer-Encoding", "chunked" );
+		req->deflating = 1;
+	}
+	add_response_header( req, "Content-Encoding", "gzip" );
+	snprintf( tag, sizeof( tag ), "%.*s-gzip\"", (int)strlen( etag ) - 1, etag );
+	set_response_header( req, "ETag", tag );
+	if( ( p = arena_strdup( &req->arena, tag ) ) == NULL )
+		return etag; // and a 500 already, see add_response_header()
+	return p;
+}
+
+/*
+ * http_encoding picks the first of catnip_encodings[] the document has a
+ * fresh sibling for (bit i of have for catnip_encodings[i]) and the client
+ * accepts. a document with any sibling at all says Vary: Accept-Encoding,
+ * even when it goes out as itself, so a cache keeps the two apart.
+ * returns the index, with Content-Encoding added, or -1 for the document.
+ */
+static int
+http_encoding( struct http_request* req, unsigned have )
+{
+	char* accept = req->headers[HEADER_ACCEPT_ENCODING];
+
+	if( have == 0 )
+		return -1;
+	add_response_header( req, "Vary", "Accept-Encoding" );
+	if( accept == NULL )
+		return -1;
+	for( int i = 0; i < CATNIP_ENCODINGS; ++i )
+		if( ( have & ( 1u << i ) ) && encoding_accepted( accept, catnip_encodings[i].token ) ){
+			add_response_header( req, "Content-Encoding", catnip_encodings[i].token );
+			return i;
+		}
+	return -1;
+}
+
+/*
+ * encoding_accepted says whether an Accept-Encoding value takes token,
+ * named or through *, with any q but q=0. we go by our own order of
+ * preference among those it takes, not the client's weights.
+ */
+static int
+encoding_accepted( char* value, char* token )
+{
+	size_t tl = strlen( token ), nl;
+	int star = 0, zero;
+	char *p, *name;
+
+	for( p = value; *p; ){
+		while( *p == ' ' || *p == '\t' || *p == ',' )
+			++p;
+		name = p;
+		p += nl = strcspn( p, " \t;," );
+		for( zero = 0; *p && *p != ','; ++p )
+			if( *p == ';' ){
+				while( p[1] == ' ' || p[1] == '\t' )
+					++p;
+				if( ( p[1] == 'q' || p[1] == 'Q' ) && p[2] == '=' ) // 0, 0. or 0.000 is a no
+					zero = p[3] == '0' && ( p[4] != '.' || strspn( p + 5, "0" ) == strcspn( p + 5, " \t;," ) );
+			}
+		if( nl == tl && strncasecmp( name, token, tl ) == 0 )
+			return !zero;
+		if( nl == 1 && *name == '*' )
+			star = !zero;
+	}
+	return star;
+}
+
+// sibling_fresh: a precompressed sibling counts while it is a file at least as new as the document
+static int
+sibling_fresh( struct stat* doc, struct stat* sib )
+{
+	return S_ISREG( sib->st_mode )
+	 && ( sib->st_mtim.tv_sec > doc->st_mtim.tv_sec
+	   || ( sib->st_mtim.tv_sec == doc->st_mtim.tv_sec && sib->st_mtim.tv_nsec >= doc->st_mtim.tv_nsec ) );
+}
+
+/*
+ * doc_etag makes a strong entity tag for a document: from its inode, size
+ * and mtime (to the nanosecond), which costs nothing, or with -e from an
+ * FNV-1a hash of its content read from fd, which costs a read of the whole
+ * document but survives a deploy that rewrites files unchanged. the
+ * listener makes it once per meta cache entry, see meta_describe().
+ */
+static void
+doc_etag( char* etag, size_t size, struct stat* st, int fd )
+{
+	unsigned char buf[16384];
+	uint64_t h = 0xcbf29ce484222325ULL;
+	off_t off = 0;
+	ssize_t n, i;
+
+	if( etag_hash && fd >= 0 ){
+		while( ( n = pread( fd, buf, sizeof( buf ), off ) ) > 0 || ( n < 0 && errno == EINTR ) ){
+			for( i = 0; i < n; ++i )
+				h = ( h ^ buf[i] ) * 0x100000001b3ULL;
+			off += n > 0 ? n : 0;
+		}
+		if( n == 0 ){
+			snprintf( etag, size, "\"%016llx\"", (unsigned long long)h );
+			return;
+		}
+	}
+	snprintf( etag, size, "\"%llx-%llx-%llx\"", (unsigned long long)st->st_ino, (unsigned long long)st->st_size,
+		(unsigned long long)st->st_mtim.tv_sec * 1000000000ULL + st->st_mtim.tv_nsec );
+}
+
+/*
+ * range_part formats what goes in front of part i of a multipart/byteranges
+ * body, or after the last part when i is range_count. returns its length.
+ */
+static int
+range_part( struct http_request* req, int i, char* buf, size_t size )
+{
+	struct catnip_range* r = &req->ranges[i];
+
+	if( i == req->range_count )
+		return snprintf( buf, size, "\r\n--%s--\r\n", req->boundary );
+	return snprintf( buf, size, "\r\n--%s\r\nContent-Type: %s\r\nContent-Range: bytes %lld-%lld/%lld\r\n\r\n",
+		req->boundary, req->range_type, (long long)r->offset, (long long)( r->offset + r->length - 1 ), (long long)req->doc_length );
+}
+
+int http_post( struct http_request* req ){
+	req->message = "Not Implemented";
+	return 501; // not implemented
+}
+
+int http_patch( struct http_request* req ){
+	req->message = "Not Implemented";
 	return 501; // not implemented
 }
 
-int http_put( int body_fd, struct http_request* req ){
+int http_put( struct http_request* req ){
 	req->message = "Not Implemented";
 	return 501; // not implemented
 }
 
-int http_options( int body_fd, struct http_request* req ){
+int http_options( struct http_request* req ){
 	req->message = "Not Implemented";
 	return 501; // not implemented
 }
 
-int http_delete( int body_fd, struct http_request* req ){
+int http_delete( struct http_request* req ){
 	req->message = "Not Implemented";
 	return 501; // not implemented
 }
 
-int http_connect( int body_fd, struct http_request* req ){
+int http_connect( struct http_request* req ){
 	req->message = "Not Implemented";
 	return 501; // not implemented
 }
 
+
+/*
+ * cn -l port: catnip as its own listener. one process, one epoll set, many
+ * connections, each fed through the same parse_http_request() and http_methods[]
+ * dispatch the pipeline uses. responses go straight back down the socket instead
+ * of via the head and body files, so there is no kittycat to nip.
+ *
+ * connections persist per http_versions[] and Connection: headers. pipelined
+ * requests are answered in order; all the responses we can build from what one
+ * read() brought in are queued together and leave in as few writes as possible.
+ */
+#ifdef __linux__
+
+#define CATNIP_MAX_EVENTS 64
+#define CATNIP_LISTEN_BACKLOG 511
+#define CATNIP_LINGER_LIMIT (256 * 1024) // most we discard from a client we are done with
+#define CATNIP_IOV_MAX 64		// pieces gathered into one sendmsg()
+#define CATNIP_INLINE_MAX 4096		// documents this small are copied in behind their head
+
+// what the io_uring backend keeps per connection, see serve_uring()
+struct catnip_ring_io {
+	struct msghdr msg; // the sendmsg in flight
+	struct iovec iov[CATNIP_IOV_MAX];
+	char*	bounce; // chunk of a document on its way from its fd to the socket
+	size_t	bounce_off, bounce_len;
+	struct statx stx; // of the document being looked up
+};
+
+static int listen_on( char* port );
+static int uring_setup( void );
+static int serve_uring( char* port, int listen_fd, char* webroot, int usefork );
+static void accept_connections( int epfd, int listen_fd, char* webroot, int usefork );
+static void conn_readable( int epfd, struct catnip_conn* conn );
+static void conn_process( int epfd, struct catnip_conn* conn );
+static void conn_respond( struct catnip_conn* conn );
+static void conn_queue( struct catnip_conn* conn );
+static int conn_echo( struct catnip_conn* conn );
+static int conn_offload( struct catnip_conn* conn );
+static struct catnip_conn* conn_new( int fd, char* webroot, int usefork );
+static int conn_flush( struct catnip_conn* conn );
+static int conn_gather( struct catnip_conn* conn, struct iovec* iov, int* more );
+static void conn_consume( struct catnip_conn* conn, size_t n );
+static void conn_pop_doc( struct catnip_conn* conn );
+static int conn_gzip_chunk( struct catnip_conn* conn, struct catnip_doc* doc );
+static int conn_inline( struct catnip_conn* conn, struct http_request* req, off_t offset, size_t size );
+static void conn_wait( int epfd, struct catnip_conn* conn, uint32_t events );
+static void conn_close( int epfd, struct catnip_conn* conn );
+
+/*
+ * the listener keeps what it learns about webroot documents: the wrangled
+ * path, the stat, an open fd, and the Content-Length and Date values made
+ * from them. a warm GET is then a hash lookup and a sendfile(). the key is
+ * the wrangled path, so /x/ and /x/index.html are separate entries for
+ * the same file; that costs a second fd, not a stale answer, since every
+ * entry on a path is dropped when inotify reports a change in its directory.
+ *
+ * responses in flight hold a reference, so an entry that is invalidated
+ * or evicted keeps its fd open until the last of them has been sent.
+ * without inotify (or outside the listener) there is no cache at all.
+ */
+#define CATNIP_META_MAX 256		// documents (and fds) kept
+#define CATNIP_META_BUCKETS 512		// power of two
+#define CATNIP_META_WATCHES 64		// directories watched
+
+static int meta_notify_fd = -1; // inotify, or -1 when the cache is off
+static struct catnip_meta* meta_buckets[CATNIP_META_BUCKETS];
+static struct catnip_meta *meta_mru, *meta_lru;
+static int meta_count;
+static struct meta_watch {
+	int	wd;
+	char*	dir; // prefix of cached paths, up to and including the last /
+} meta_watches[CATNIP_META_WATCHES];
+static int meta_watch_count;
+static unsigned meta_generation; // bumped by every meta_changed(), see meta_adopt()
+static __thread int meta_detached; // on pool threads: 1 open entries for the event loop to adopt, -1 do without
+static __thread struct catnip_meta* meta_looked; // what the ring's lookup found for the request being answered, see uring_looked()
+
+static struct catnip_meta* meta_find( char* path, unsigned hash );
+static struct catnip_meta* meta_open( char* path );
+static struct catnip_meta* meta_new( char* path );
+static void meta_describe( struct catnip_meta* meta );
+static void meta_variants( struct catnip_meta* meta );
+static void meta_forget( char* path );
+static void meta_insert( struct catnip_meta* meta );
+static void meta_make_room( struct catnip_meta* meta, size_t size );
+static void meta_drop( struct catnip_meta* meta );
+static void meta_release( struct catnip_meta* meta );
+static int meta_watch( char* path, size_t dirlen );
+
+static int
+meta_cache_init( char* webroot )
+{
+	if( ( meta_notify_fd = inotify_init1( IN_NONBLOCK|IN_CLOEXEC ) ) < 0 ){
+		warn( "inotify, not caching webroot metadata" );
+		return -1;
+	}
+	if( verbosity >= 1 )fprintf( stderr, "catnip: caching metadata under %s\n", webroot );
+	return meta_notify_fd;
+}
+
+static struct catnip_meta*
+meta_lookup( char* path )
+{
+	struct catnip_meta* meta;
+	unsigned hash;
+	size_t dirlen;
+	char* slash;
+
+	if( meta_looked != NULL ) // looked up (and counted) already
+		return meta_looked;
+	if( meta_detached ) // a pool thread, the cache is not ours to touch
+		return meta_detached > 0 ? meta_open( path ) : NULL;
+	if( meta_notify_fd < 0 )
+		return NULL;
+	hash = catnip_hash( path, strlen( path ), 0, 0 );
+	if( ( meta = meta_find( path, hash ) ) != NULL ){
+		++stats.meta_hits;
+		if( meta != meta_mru ){ // to the front
+			meta->prev->next = meta->next;
+			if( meta->next != NULL )
+				meta->next->prev = meta->prev;
+			else
+				meta_lru = meta->prev;
+			meta->prev = NULL;
+			meta->next = meta_mru;
+			meta_mru->prev = meta;
+			meta_mru = meta;
+		}
+		return meta;
+	}
+	++stats.meta_misses;
+	// watch first, so a change between here and the open cannot slip by
+	dirlen = ( slash = strrchr( path, '/' ) ) != NULL ? slash - path + 1 : 0;
+	if( meta_watch( path, dirlen ) < 0 )
+		return NULL;
+	if( ( meta = meta_open( path ) ) == NULL )
+		return NULL; // http_head() works out what to say about it
+	meta_insert( meta );
+	return meta;
+}
+
+static struct catnip_meta*
+meta_find( char* path, unsigned hash )
+{
+	struct catnip_meta* meta;
+
+	for( meta = meta_buckets[hash & (CATNIP_META_BUCKETS - 1)]; meta != NULL; meta = meta->hnext )
+		if( meta->hash == hash && strcmp( meta->path, path ) == 0 )
+			break;
+	return meta;
+}
+
+/*
+ * meta_open makes an entry for path, holding the cache's reference but not
+ * yet in it. it touches nothing shared, so a pool thread can do the open
+ * and the stat and leave meta_insert() (or meta_adopt()) to the event loop.
+ */
+static struct catnip_meta*
+meta_open( char* path )
+{
+	struct catnip_meta* meta;
+	int fd;
+
+	if( ( fd = open( path, O_RDONLY|O_CLOEXEC ) ) < 0 )
+		return NULL;
+	if( ( meta = meta_new( path ) ) == NULL ){
+		close( fd );
+		return NULL;
+	}
+	meta->fd = fd;
+	if( fstat( fd, &meta->st ) < 0 || !S_ISREG( meta->st.st_mode ) ){
+		meta_release( meta );
+		return NULL;
+	}
+	meta_describe( meta );
+	return meta;
+}
+
+// meta_new: an entry for path with no file behind it yet
+static struct catnip_meta*
+meta_new( char* path )
+{
+	struct catnip_meta* meta;
+	size_t len = strlen( path );
+
+	if( ( meta = catnip_calloc( 1, sizeof( struct catnip_meta ) + len + 1 ) ) == NULL )
+		return NULL;
+	meta->path = memcpy( (char*)( meta + 1 ), path, len + 1 );
+	meta->hash = catnip_hash( path, len, 0, 0 );
+	meta->fd = -1;
+	meta->refs = 1; // the cache's own
+	return meta;
+}
+
+// meta_describe makes the header values from st (and with -e, from the content)
+static void
+meta_describe( struct catnip_meta* meta )
+{
+	struct tm tm;
+
+	snprintf( meta->content_length, sizeof( meta->content_length ), "%lld", (long long)meta->st.st_size );
+	if( gmtime_r( &meta->st.st_mtim.tv_sec, &tm ) == NULL
+	 || strftime( meta->last_modified, sizeof( meta->last_modified ), "%a, %d %b %Y %H:%M:%S %Z", &tm ) == 0 )
+		meta->last_modified[0] = '\0';
+	doc_etag( meta->etag, sizeof( meta->etag ), &meta->st, meta->fd );
+	if( meta->parent == NULL )
+		meta_variants( meta );
+}
+
+/*
+ * meta_variants opens the fresh precompressed siblings of a document along
+ * with it, so a warm request picks one without a stat. they ride on the
+ * entry: meta_changed() drops it when a sibling changes, and they go when
+ * it does. blocking opens, like the rest of meta_describe(), once an entry.
+ */
+static void
+meta_variants( struct catnip_meta* meta )
+{
+	char path[PATH_MAX];
+	struct catnip_meta* v;
+	struct stat st;
+	int fd;
+
+	for( int i = 0; i < CATNIP_ENCODINGS; ++i ){
+		if( snprintf( path, sizeof( path ), "%s%s", meta->path, catnip_encodings[i].suffix ) >= (int)sizeof( path ) )
+			continue;
+		if( ( fd = open( path, O_RDONLY|O_CLOEXEC ) ) < 0 )
+			continue;
+		if( fstat( fd, &st ) < 0 || !sibling_fresh( &meta->st, &st ) || ( v = meta_new( path ) ) == NULL ){
+			close( fd );
+			continue;
+		}
+		v->fd = fd;
+		v->st = st;
+		v->parent = meta;
+		meta_describe( v );
+		meta->variant[i] = v;
+	}
+}
+
+static void
+meta_insert( struct catnip_meta* meta )
+{
+	unsigned bucket = meta->hash & (CATNIP_META_BUCKETS - 1);
+
+	if( meta_count >= CATNIP_META_MAX )
+		meta_drop( meta_lru );
+	meta->hnext = meta_buckets[bucket];
+	meta_buckets[bucket] = meta;
+	meta->prev = NULL;
+	if( ( meta->next = meta_mru ) != NULL )
+		meta_mru->prev = meta;
+	else
+		meta_lru = meta;
+	meta_mru = meta;
+	++meta_count;
+	if( meta->data != NULL )
+		stats.content_bytes += meta->st.st_size;
+}
+
+/*
+ * meta_adopt takes an entry a pool thread opened into the cache, unless
+ * inotify has reported anything since the job went out (it may have been
+ * this file) or another request cached the path first. the response that
+ * came back with it holds its own reference either way.
+ */
+static void
+meta_adopt( struct catnip_meta* meta, unsigned generation )
+{
+	if( generation != meta_generation || meta_find( meta->path, meta->hash ) != NULL ){
+		meta_release( meta ); // the cache's reference, see meta_open()
+		return;
+	}
+	if( meta->data != NULL ){
+		++stats.content_misses;
+		meta_make_room( meta, meta->st.st_size );
+	}
+	meta_insert( meta );
+}
+
+/*
+ * meta_watch makes sure inotify tells us about the directory holding path.
+ * every distinct prefix gets a slot, even when inotify hands back the same
+ * wd for two spellings of one directory; meta_changed() tries them all.
+ */
+static int
+meta_watch( char* path, size_t dirlen )
+{
+	struct meta_watch* w;
+	char* dir;
+	int wd;
+
+	for( int i = 0; i < meta_watch_count; ++i ){
+		w = &meta_watches[i];
+		if( strncmp( w->dir, path, dirlen ) == 0 && w->dir[dirlen] == '\0' )
+			return 0;
+	}
+	if( meta_watch_count >= CATNIP_META_WATCHES )
+		return -1; // too many directories, leave the rest uncached
+	if( ( dir = catnip_malloc( dirlen + 2 ) ) == NULL )
+		return -1;
+	memcpy( dir, path, dirlen );
+	dir[dirlen] = '\0';
+	wd = inotify_add_watch( meta_notify_fd, dirlen ? dir : ".",
+		IN_MODIFY|IN_ATTRIB|IN_CLOSE_WRITE|IN_CREATE|IN_DELETE|IN_MOVED_FROM|IN_MOVED_TO|IN_DELETE_SELF|IN_MOVE_SELF );
+	if( wd < 0 ){
+		if( verbosity >= 1 )warn( "inotify_add_watch %s", dirlen ? dir : "." );
+		free( dir );
+		return -1;
+	}
+	w = &meta_watches[meta_watch_count++];
+	w->wd = wd;
+	w->dir = dir;
+	return 0;
+}
+
+/*
+ * meta_changed drains the inotify queue, dropping the entries for every
+ * name it mentions. when the queue overflowed or a watched directory itself
+ * went away we no longer know what changed, so everything goes.
+ */
+static void
+meta_changed( int fd )
+{
+	char buf[4096] __attribute__(( aligned( __alignof__( struct inotify_event ) ) ));
+	struct inotify_event* ev;
+	ssize_t n;
+	char path[PATH_MAX];
+	struct catnip_meta *meta, *next;
+
+	++meta_generation;
+	while( ( n = read( fd, buf, sizeof( buf ) ) ) > 0 ){
+		for( char* p = buf; p < buf + n; p += sizeof( struct inotify_event ) + ev->len ){
+			ev = (struct inotify_event*)p;
+			if( ev->mask & ( IN_Q_OVERFLOW|IN_IGNORED|IN_DELETE_SELF|IN_MOVE_SELF ) ){
+				if( verbosity >= 1 )fprintf( stderr, "catnip: inotify 0x%x, forgetting all metadata\n", ev->mask );
+				for( meta = meta_mru; meta != NULL; meta = next ){
+					next = meta->next;
+					++stats.meta_invalidations;
+					meta_drop( meta );
+				}
+				if( ev->mask & IN_IGNORED ) // the watch is gone, forget it so it can be added again
+					for( int i = 0; i < meta_watch_count; ++i )
+						if( meta_watches[i].wd == ev->wd ){
+							free( meta_watches[i].dir );
+							meta_watches[i--] = meta_watches[--meta_watch_count];
+						}
+				continue;
+			}
+			if( ev->len == 0 )
+				continue;
+			for( int i = 0; i < meta_watch_count; ++i ){
+				if( meta_watches[i].wd != ev->wd )
+					continue;
+				snprintf( path, sizeof( path ), "%s%s", meta_watches[i].dir, ev->name );
+				meta_forget( path );
+				for( int j = 0; j < CATNIP_ENCODINGS; ++j ){ // a sibling came, went or changed: its document's entry goes too
+					size_t len = strlen( path ), sl = strlen( catnip_encodings[j].suffix );
+					if( len > sl && strcmp( path + len - sl, catnip_encodings[j].suffix ) == 0 ){
+						path[len - sl] = '\0';
+						meta_forget( path );
+						break;
+					}
+				}
+			}
+		}
+	}
+}
+
+// meta_forget drops the entry for path, if there is one
+static void
+meta_forget( char* path )
+{
+	struct catnip_meta *meta, *next;
+	unsigned hash = catnip_hash( path, strlen( path ), 0, 0 );
+
+	for( meta = meta_buckets[hash & (CATNIP_META_BUCKETS - 1)]; meta != NULL; meta = next ){
+		next = meta->hnext;
+		if( meta->hash == hash && strcmp( meta->path, path ) == 0 ){
+			if( verbosity >= 1 )fprintf( stderr, "catnip: %s changed\n", path );
+			++stats.meta_invalidations;
+			meta_drop( meta );
+		}
+	}
+}
+
+// meta_drop takes an entry out of the cache; it lives on while responses use it
+static void
+meta_drop( struct catnip_meta* meta )
+{
+	struct catnip_meta** pp;
+
+	for( pp = &meta_buckets[meta->hash & (CATNIP_META_BUCKETS - 1)]; *pp != meta; pp = &(*pp)->hnext )
+		;
+	*pp = meta->hnext;
+	if( meta->prev != NULL )
+		meta->prev->next = meta->next;
+	else
+		meta_mru = meta->next;
+	if( meta->next != NULL )
+		meta->next->prev = meta->prev;
+	else
+		meta_lru = meta->prev;
+	--meta_count;
+	if( meta->data != NULL )
+		stats.content_bytes -= meta->st.st_size;
+	meta_release( meta );
+}
+
+static void
+meta_release( struct catnip_meta* meta )
+{
+	if( --meta->refs > 0 )
+		return;
+	for( int i = 0; i < CATNIP_ENCODINGS; ++i )
+		if( meta->variant[i] != NULL )
+			meta_release( meta->variant[i] );
+	if( meta->fd >= 0 )
+		close( meta->fd );
+	free( meta->data );
+	free( meta );
+}
+
+/*
+ * meta_content reads a document into memory the first time it is sent,
+ * when it is no bigger than -M, and makes room under the -C budget by
+ * dropping the least recently used documents that are held in memory.
+ * the bytes are a copy rather than a mapping, so a file truncated under
+ * us cannot fault the listener; inotify drops the copy like the rest.
+ * on a pool thread the entry is not in the cache yet, and meta_adopt()
+ * does the accounting.
+ */
+static char*
+meta_content( struct catnip_meta* meta )
+{
+	size_t size = meta->st.st_size;
+	char* data;
+	ssize_t n;
+
+	if( meta->data != NULL ){
+		++stats.content_hits;
+		return meta->data;
+	}
+	if( size == 0 || size > content_max || size > content_budget )
+		return NULL;
+	if( !meta_detached )
+		meta_make_room( meta, size );
+	if( ( data = catnip_malloc( size ) ) == NULL )
+		return NULL;
+	for( size_t got = 0; got < size; got += n )
+		if( ( n = pread( meta->fd, data + got, size - got, got ) ) <= 0 ){
+			if( n < 0 && errno == EINTR ){
+				n = 0;
+				continue;
+			}
+			free( data ); // shrank or failed, sendfile will sort it out
+			return NULL;
+		}
+	if( meta_detached )
+		return meta->data = data;
+	++stats.content_misses;
+	stats.content_bytes += size;
+	return meta->data = data;
+}
+
+// meta_make_room drops documents held in memory, least recently used first, until size more fits under -C
+static void
+meta_make_room( struct catnip_meta* meta, size_t size )
+{
+	struct catnip_meta *victim, *prev;
+
+	for( victim = meta_lru; victim != NULL && stats.content_bytes + size > content_budget; victim = prev ){
+		prev = victim->prev;
+		if( victim->data == NULL || victim == meta )
+			continue;
+		if( verbosity >= 1 )fprintf( stderr, "catnip: evicting %s from memory\n", victim->path );
+		++stats.content_evictions;
+		meta_drop( victim ); // its memory stays with any response still sending it
+	}
+}
+
+// release_doc lets go of a staged document, whoever owns its fd
+static void
+release_doc( int fd, struct catnip_meta* meta )
+{
+	if( meta != NULL )
+		meta_release( meta );
+	else
+		close( fd );
+}
+
+// closed connections and finished docs wait here for the next ones
+static struct catnip_conn* conn_pool;
+static int conn_pool_count;
+static struct catnip_doc* doc_pool;
+static volatile sig_atomic_t stats_wanted; // SIGUSR1
+static int reuseport; // listen_on() sets SO_REUSEPORT, for -j workers
+
+static void
+catch_usr1( int sig )
+{
+	(void)sig;
+	stats_wanted = 1;
+}
+
+/*
+ * the pool takes actions that would block on the disk off the event loop.
+ * each of its -T threads has a deque of jobs. the event loop deals jobs
+ * round robin onto the bottoms; a thread works its own deque from the
+ * bottom, newest first, and when that runs dry steals the oldest from the
+ * top of the others before it sleeps. finished jobs come back on one list,
+ * and an eventfd in the epoll set says when to run their done().
+ *
+ * stats.pool_depth counts jobs handed out and not yet taken, across all the
+ * deques; print_stats() shows it with its max and mean (as seen by each new
+ * job), which is what to watch when choosing -T.
+ */
+static struct catnip_deque* pool_deques; // pool_threads of them, NULL without a pool
+static unsigned pool_next; // deque the next job is dealt to
+static pthread_mutex_t pool_idle_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_idle = PTHREAD_COND_INITIALIZER; // stats.pool_depth went up
+static pthread_mutex_t pool_done_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct catnip_job* pool_done; // finished, newest first
+static int pool_done_fd = -1;
+
+static void* pool_thread( void* arg );
+
+static int
+pool_start( int n )
+{
+	sigset_t all, old;
+	int e;
+
+	if( n <= 0 )
+		return -1;
+	if( ( pool_done_fd = eventfd( 0, EFD_NONBLOCK|EFD_CLOEXEC ) ) < 0 ){
+		warn( "eventfd, handlers stay on the event loop" );
+		return -1;
+	}
+	if( ( pool_deques = catnip_calloc( n, sizeof( struct catnip_deque ) ) ) == NULL )
+		err(1, "pool");
+	for( int i = 0; i < n; ++i ){ // all of them before any thread goes looking
+		pthread_mutex_init( &pool_deques[i].lock, NULL );
+		pool_deques[i].index = i;
+		pool_deques[i].cap = 64;
+		if( ( pool_deques[i].jobs = catnip_malloc( 64 * sizeof( struct catnip_job* ) ) ) == NULL )
+			err(1, "pool");
+	}
+	sigfillset( &all ); // signals are the event loop's business
+	pthread_sigmask( SIG_BLOCK, &all, &old );
+	for( int i = 0; i < n; ++i )
+		if( ( e = pthread_create( &pool_deques[i].thread, NULL, pool_thread, &pool_deques[i] ) ) != 0 )
+			errx(1, "pthread_create: %s", strerror( e ));
+	pthread_sigmask( SIG_SETMASK, &old, NULL );
+	return pool_done_fd;
+}
+
+static void
+deque_push( struct catnip_deque* d, struct catnip_job* job )
+{
+	struct catnip_job** jobs;
+
+	pthread_mutex_lock( &d->lock );
+	if( d->bottom - d->top == d->cap ){ // full, double it
+		if( ( jobs = catnip_malloc( 2 * d->cap * sizeof( struct catnip_job* ) ) ) == NULL )
+			err(1, "pool");
+		for( size_t i = d->top; i < d->bottom; ++i )
+			jobs[i & (2 * d->cap - 1)] = d->jobs[i & (d->cap - 1)];
+		free( d->jobs );
+		d->jobs = jobs;
+		d->cap *= 2;
+	}
+	d->jobs[d->bottom++ & (d->cap - 1)] = job;
+	pthread_mutex_unlock( &d->lock );
+}
+
+// deque_take: the owner's newest from the bottom, or with steal the oldest from the top
+static struct catnip_job*
+deque_take( struct catnip_deque* d, int steal )
+{
+	struct catnip_job* job = NULL;
+
+	pthread_mutex_lock( &d->lock );
+	if( d->top != d->bottom )
+		job = steal ? d->jobs[d->top++ & (d->cap - 1)] : d->jobs[--d->bottom & (d->cap - 1)];
+	pthread_mutex_unlock( &d->lock );
+	return job;
+}
+
+static void
+pool_submit( struct catnip_job* job )
+{
+	unsigned long depth;
+
+	// count it first, so a thread that sees the count and finds nothing just looks again
+	depth = __atomic_add_fetch( &stats.pool_depth, 1, __ATOMIC_RELEASE );
+	deque_push( &pool_deques[pool_next++ % pool_threads], job );
+	pthread_mutex_lock( &pool_idle_lock );
+	pthread_cond_signal( &pool_idle );
+	pthread_mutex_unlock( &pool_idle_lock );
+	++stats.pool_jobs;
+	stats.pool_depth_total += depth;
+	if( depth > stats.pool_depth_max )
+		stats.pool_depth_max = depth;
+}
+
+static void*
+pool_thread( void* arg )
+{
+	struct catnip_deque* self = arg;
+	struct catnip_job* job;
+	uint64_t one = 1;
+
+	meta_detached = -1; // not the event loop, see meta_lookup()
+	for( ;; ){
+		job = deque_take( self, 0 );
+		for( int i = 1; job == NULL && i < pool_threads; ++i )
+			if( ( job = deque_take( &pool_deques[( self->index + i ) % pool_threads], 1 ) ) != NULL )
+				__atomic_add_fetch( &stats.pool_stolen, 1, __ATOMIC_RELAXED );
+		if( job == NULL ){
+			pthread_mutex_lock( &pool_idle_lock );
+			while( __atomic_load_n( &stats.pool_depth, __ATOMIC_ACQUIRE ) == 0 )
+				pthread_cond_wait( &pool_idle, &pool_idle_lock );
+			pthread_mutex_unlock( &pool_idle_lock );
+			continue;
+		}
+		__atomic_sub_fetch( &stats.pool_depth, 1, __ATOMIC_RELAXED );
+		job->run( job );
+		pthread_mutex_lock( &pool_done_lock );
+		job->next = pool_done;
+		pool_done = job;
+		pthread_mutex_unlock( &pool_done_lock );
+		while( write( pool_done_fd, &one, sizeof( one ) ) < 0 && errno == EINTR )
+			;
+	}
+	/* NOTREACHED */
+	return NULL;
+}
+
+// pool_finished runs done() for every job that has come back, in the order they finished
+static void
+pool_finished( int epfd )
+{
+	uint64_t n;
+	struct catnip_job *job, *next, *done = NULL;
+
+	while( read( pool_done_fd, &n, sizeof( n ) ) < 0 && errno == EINTR )
+		;
+	pthread_mutex_lock( &pool_done_lock );
+	job = pool_done;
+	pool_done = NULL;
+	pthread_mutex_unlock( &pool_done_lock );
+	for( ; job != NULL; job = next ){
+		next = job->next;
+		job->next = done;
+		done = job;
+	}
+	for( job = done; job != NULL; job = next ){
+		next = job->next; // done() may hand the connection, job and all, out again
+		job->done( job, epfd );
+	}
+}
+
+static int
+serve_http( char* port, char* webroot, int usefork )
+{
+	int listen_fd, epfd, n, notify_fd, pool_fd;
+	struct epoll_event ev, events[CATNIP_MAX_EVENTS];
+	static struct catnip_conn notify, finished; // stand in for connections in epoll data
+
+	signal( SIGPIPE, SIG_IGN ); // a vanished client is an error return, not a death
+	signal( SIGUSR1, catch_usr1 ); // kill -USR1 for print_stats()
+	listen_fd = listen_on( port );
+	if( strcmp( backend, "epoll" ) != 0 ){
+		if( uring_setup() == 0 )
+			return serve_uring( port, listen_fd, webroot, usefork );
+		if( strcmp( backend, "uring" ) == 0 || verbosity >= 1 )
+			fprintf( stderr, "catnip: no io_uring here, using epoll\n" );
+	}
+	if( ( epfd = epoll_create1( EPOLL_CLOEXEC ) ) < 0 )
+		err(1, "epoll_create1");
+	ev.events = EPOLLIN;
+	ev.data.ptr = NULL; // the listener is the only event without a connection
+	if( epoll_ctl( epfd, EPOLL_CTL_ADD, listen_fd, &ev ) < 0 )
+		err(1, "epoll_ctl");
+	if( ( notify_fd = meta_cache_init( webroot ) ) >= 0 ){
+		ev.data.ptr = &notify;
+		if( epoll_ctl( epfd, EPOLL_CTL_ADD, notify_fd, &ev ) < 0 )
+			err(1, "epoll_ctl");
+	}
+	if( ( pool_fd = pool_start( pool_threads ) ) >= 0 ){
+		ev.data.ptr = &finished;
+		if( epoll_ctl( epfd, EPOLL_CTL_ADD, pool_fd, &ev ) < 0 )
+			err(1, "epoll_ctl");
+	}
+	if( verbosity >= 0 )fprintf( stderr, "catnip: listening on port %s, webroot %s, %d handler threads\n", port, webroot, pool_fd >= 0 ? pool_threads : 0 );
+
+	for( ;; ){
+		if( ( n = epoll_wait( epfd, events, CATNIP_MAX_EVENTS, -1 ) ) < 0 ){
+			if( errno == EINTR ){
+				if( stats_wanted ){
+					stats_wanted = 0;
+					print_stats( stderr );
+				}
+				continue;
+			}
+			err(1, "epoll_wait");
+		}
+		for( int i = 0; i < n; ++i ){
+			struct catnip_conn* conn = events[i].data.ptr;
+			if( conn == NULL ){
+				accept_connections( epfd, listen_fd, webroot, usefork );
+				continue;
+			}
+			if( conn == &notify ){
+				meta_changed( notify_fd );
+				continue;
+			}
+			if( conn == &finished ){
+				pool_finished( epfd );
+				continue;
+			}
+			if( events[i].events & EPOLLIN )
+				conn_readable( epfd, conn );
+			else if( events[i].events & EPOLLOUT )
+				conn_process( epfd, conn ); // flush, then pick up any buffered requests
+			else
+				conn_close( epfd, conn ); // EPOLLERR or EPOLLHUP alone
+		}
+	}
+	/* NOTREACHED */
+	return 0;
+}
+
+/*
+ * listen_on binds a non-blocking listener to port on every local address.
+ */
+static int
+listen_on( char* port )
+{
+	struct addrinfo hints, *res, *ai;
+	int fd = -1, one = 1, e;
+
+	memset( &hints, 0, sizeof( hints ) );
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE;
+	if( ( e = getaddrinfo( NULL, port, &hints, &res ) ) != 0 )
+		errx(1, "port %s: %s", port, gai_strerror( e ));
+	// prefer a dual-stack v6 socket when there is one, it takes the v4 clients too
+	for( ai = res; ai != NULL; ai = ai->ai_next )
+		if( ai->ai_family == AF_INET6 )
+			break;
+	if( ai == NULL )
+		ai = res;
+	for( ; ai != NULL; ai = ai->ai_next ){
+		if( ( fd = socket( ai->ai_family, ai->ai_socktype|SOCK_NONBLOCK|SOCK_CLOEXEC, ai->ai_protocol ) ) < 0 )
+			continue;
+		setsockopt( fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof( one ) );
+		if( reuseport )
+			setsockopt( fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof( one ) );
+		if( bind( fd, ai->ai_addr, ai->ai_addrlen ) == 0 && listen( fd, CATNIP_LISTEN_BACKLOG ) == 0 )
+			break;
+		close( fd );
+		fd = -1;
+	}
+	freeaddrinfo( res );
+	if( fd < 0 )
+		err(1, "listen on port %s", port);
+	return fd;
+}
+
+static void
+accept_connections( int epfd, int listen_fd, char* webroot, int usefork )
+{
+	int fd;
+	struct catnip_conn* conn;
+	struct epoll_event ev;
+
+	while( ( fd = accept4( listen_fd, NULL, NULL, SOCK_NONBLOCK|SOCK_CLOEXEC ) ) >= 0 ){
+		if( ( conn = conn_new( fd, webroot, usefork ) ) == NULL )
+			continue;
+		conn->events = ev.events = EPOLLIN;
+		ev.data.ptr = conn;
+		if( epoll_ctl( epfd, EPOLL_CTL_ADD, fd, &ev ) < 0 ){
+			warn( "epoll_ctl" );
+			conn->docs = NULL;
+			conn_close( -1, conn );
+		}
+	}
+	if( errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR )
+		warn( "accept" );
+}
+
+// conn_new sets up a connection for a freshly accepted fd, from the pool if it can
+static struct catnip_conn*
+conn_new( int fd, char* webroot, int usefork )
+{
+	struct catnip_conn* conn;
+
+	if( ( conn = conn_pool ) != NULL ){
+		struct catnip_buffer out = conn->out; // keep the buffer it grew
+		struct catnip_ring_io* io = conn->io;
+		conn_pool = conn->next_free;
+		--conn_pool_count;
+		++stats.pooled;
+		memset( conn, 0, sizeof( struct catnip_conn ) );
+		conn->out.data = out.data;
+		conn->out.cap = out.cap;
+		conn->io = io;
+	}
+	else if( ( conn = catnip_calloc( 1, sizeof( struct catnip_conn ) ) ) == NULL ){
+		warn( "connection" );
+		close( fd );
+		return NULL;
+	}
+	conn->req = alloc_http_request();
+	conn->fd = fd;
+	conn->req->webroot = webroot;
+	conn->req->usefork = usefork;
+	conn->req->allow_keep_alive = 1;
+	return conn;
+}
+
+/*
+ * conn_readable appends what the client sent to the request buffer,
+ * then answers every request that is now complete.
+ */
+static void
+conn_readable( int epfd, struct catnip_conn* conn )
+{
+	struct http_request* req = conn->req;
+	ssize_t n;
+
+	if( conn->lingering ){
+		char discard[4096];
+		// we have said our last; swallow what the client still sends so closing
+		// does not reset the connection under our final response
+		while( ( n = read( conn->fd, discard, sizeof( discard ) ) ) < 0 && errno == EINTR )
+			;
+		if( n < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK ) )
+			return;
+		if( n <= 0 || ( conn->lingering += n ) > CATNIP_LINGER_LIMIT )
+			conn_close( epfd, conn );
+		return;
+	}
+	// the parser always leaves room for the next read
+	while( ( n = read( conn->fd, req->buf + req->nr, req->bsize - req->nr ) ) < 0 && errno == EINTR )
+		;
+	if( n < 0 ){
+		if( errno != EAGAIN && errno != EWOULDBLOCK )
+			conn_close( epfd, conn );
+		return;
+	}
+	if( n == 0 )
+		conn->eof = 1; // nothing more will come, answer what did
+	else if( verbosity >= 1 )fprintf( stderr, "read %ld bytes on fd %d\n", n, conn->fd );
+	req->nr += n;
+	conn_process( epfd, conn );
+}
+
+/*
+ * conn_process queues a response for each complete request in the buffer,
+ * in order, then pushes out as much as the socket will take. while output
+ * is backed up we stop reading, so a pipelining client cannot run us out of memory.
+ */
+static void
+conn_process( int epfd, struct catnip_conn* conn )
+{
+	struct http_request* req = conn->req;
+
+	if( conn->out.off < conn->out.len || conn->docs != NULL ){
+		switch( conn_flush( conn ) ){ // older responses first
+		case 0:
+			break;
+		case 1:
+			conn_wait( epfd, conn, EPOLLOUT );
+			return;
+		default:
+			conn_close( epfd, conn );
+			return;
+		}
+	}
+	while( !conn->closing && !conn->offloaded ){
+		if( req->body_pending > 0 ){ // answered already, echoing the body
+			if( conn_echo( conn ) )
+				break; // wait for the rest
+		}
+		else{
+			if( parse_http_request( req ) == PARSE_NEED_MORE )
+				break; // wait for the rest
+			if( conn_offload( conn ) )
+				break; // the pool has it, conn_offloaded() carries on
+			conn_respond( conn );
+			if( req->body_pending > 0 )
+				continue; // see conn_echo()
+		}
+		if( req->keep_alive )
+			next_http_request( req );
+		else
+			conn->closing = 1;
+	}
+	if( conn->eof && !conn->closing && !conn->offloaded ){
+		if( req->nr > 0 && verbosity >= 1 )fprintf( stderr, "catnip: fd %d hung up mid request\n", conn->fd );
+		conn->closing = 1; // nobody to answer any more
+	}
+	switch( conn_flush( conn ) ){
+	case 0:
+		if( conn->closing && ( conn->eof || shutdown( conn->fd, SHUT_WR ) < 0 ) )
+			conn_close( epfd, conn );
+		else{
+			if( conn->closing )
+				conn->lingering = 1; // half closed, see conn_readable()
+			// nothing to read into while the request is out, just hear about a hangup
+			conn_wait( epfd, conn, conn->offloaded ? 0 : EPOLLIN );
+		}
+		break;
+	case 1:
+		conn_wait( epfd, conn, EPOLLOUT ); // the rest when the socket has room
+		break;
+	default:
+		conn_close( epfd, conn );
+		break;
+	}
+}
+
+/*
+ * conn_respond runs the action and queues the head, then the body, behind
+ * any responses already waiting on the connection.
+ */
+static void
+conn_respond( struct catnip_conn* conn )
+{
+	struct http_request* req = conn->req;
+	unsigned long mallocs = stats.mallocs;
+
+	if( req->e && verbosity >= 0 )fprintf( stderr, "got error code %d while parsing, state = %d\n", req->e, req->state );
+	dispatch_request( req );
+	conn_queue( conn );
+	if( verbosity >= 1 )fprintf( stderr, "catnip: fd %d %s %s took %lu mallocs\n", conn->fd, req->method, req->target, stats.mallocs - mallocs );
+}
+
+/*
+ * conn_queue queues the head and body dispatch_request() left in req. a
+ * document goes out whole, or as the ranges http_range() found, each part
+ * of a multipart/byteranges body with its head in out ahead of it. every
+ * doc queued holds a reference of its own (a meta ref, or a dup()), and
+ * req's is let go at the end.
+ */
+static void
+conn_queue( struct catnip_conn* conn )
+{
+	struct http_request* req = conn->req;
+	struct catnip_range whole = { 0, req->doc_length }, *r;
+	struct catnip_doc* doc;
+	char part[512];
+	int i, n, fd;
+
+	write_http_response( &conn->out, req );
+	if( req->doc_fd >= 0 ){
+		r = req->ranges != NULL ? req->ranges : &whole;
+		n = req->ranges != NULL ? req->range_count : 1;
+		for( i = 0; i <= n; ++i ){
+			if( req->boundary != NULL )
+				buffer_append( &conn->out, part, range_part( req, i, part, sizeof( part ) ) );
+			if( i == n )
+				break;
+			if( !req->deflating && r[i].length <= CATNIP_INLINE_MAX && conn_inline( conn, req, r[i].offset, r[i].length ) == 0 )
+				continue; // it is all in out now
+			if( req->doc_meta != NULL )
+				++req->doc_meta->refs;
+			else if( ( fd = dup( req->doc_fd ) ) < 0 ){
+				warn( "dup" ); // out of fds, the client sees a short body and a close
+				conn->closing = 1;
+				break;
+			}
+			if( ( doc = doc_pool ) != NULL ){
+				doc_pool = doc->next;
+				++stats.pooled;
+			}
+			else if( ( doc = catnip_malloc( sizeof( struct catnip_doc ) ) ) == NULL )
+				err(1, "doc");
+			doc->fd = req->doc_meta != NULL ? req->doc_fd : fd;
+			doc->meta = req->doc_meta;
+			doc->data = doc->meta != NULL ? doc->meta->data : NULL;
+			doc->offset = r[i].offset;
+			doc->remaining = r[i].length;
+			doc->gzip = NULL;
+			if( req->deflating ){
+				if( ( doc->gzip = gzip_start( doc->fd, doc->data, r[i].length, doc->meta != NULL ? doc->meta->path : req->doc_path ) ) == NULL )
+					err(1, "gzip");
+				conn_gzip_chunk( conn, doc );
+			}
+			doc->at = conn->out.len;
+			doc->next = NULL;
+			if( conn->last_doc != NULL )
+				conn->last_doc->next = doc;
+			else
+				conn->docs = doc;
+			conn->last_doc = doc;
+		}
+		release_doc( req->doc_fd, req->doc_meta );
+		req->doc_fd = -1;
+		req->doc_meta = NULL;
+	}
+	else if( req->chunked ){
+		buffer_chunk( &conn->out, req->reply, req->reply != NULL ? req->reply_length : 0 );
+		if( req->body_pending == 0 )
+			buffer_append( &conn->out, CATNIP_LAST_CHUNK, sizeof( CATNIP_LAST_CHUNK ) - 1 );
+	}
+	else if( req->reply != NULL && req->reply_length > 0 )
+		buffer_append( &conn->out, req->reply, req->reply_length );
+}
+
+/*
+ * conn_echo queues what has come in of a TRACE body that was still coming
+ * when the request was answered (body_pending) as the next chunk, and the
+ * last chunk once it is all in. the head has been answered, so while more
+ * is to come the whole buffer is the body's; the next read lands at the
+ * top of it, and memory stays at that whatever the Content-Length. the
+ * backends read no more while the out buffer is backed up, as ever.
+ * returns 1 while more is to come, 0 once the request is done with.
+ */
+static int
+conn_echo( struct catnip_conn* conn )
+{
+	struct http_request* req = conn->req;
+	char* p = req->body + req->body_length;
+	off_t n = req->buf + req->nr - p;
+
+	if( n > req->body_pending )
+		n = req->body_pending; // the rest is the next request's
+	buffer_chunk( &conn->out, p, n );
+	req->body_pending -= n;
+	req->body_length += n;
+	if( req->body_pending == 0 ){
+		buffer_append( &conn->out, CATNIP_LAST_CHUNK, sizeof( CATNIP_LAST_CHUNK ) - 1 );
+		return 0;
+	}
+	req->body = req->buf; // nothing of the head is needed any more
+	req->body_length = 0;
+	req->nr = 0;
+	return 1;
+}
+
+/*
+ * conn_offload hands a GET or HEAD for a document the metadata cache has
+ * not seen to the pool: the action runs there, access(), stat(), open(),
+ * the first read and all, while the event loop gets on with the other
+ * connections. a cached document (and any other method) is answered in
+ * place; that costs less than the round trip. the pool thread opens the
+ * entry for the cache and conn_offloaded() puts it there, so the next
+ * request for the path is a warm one. returns 1 if the request went out.
+ */
+static void conn_run( struct catnip_job* job );
+static void conn_offloaded( struct catnip_job* job, int epfd );
+
+static int
+conn_offload( struct catnip_conn* conn )
+{
+	struct http_request* req = conn->req;
+	char *path, *slash;
+
+	if( pool_deques == NULL || req->e || req->state != WANT_BODY || req->map == NULL )
+		return 0;
+	if( req->map->action != http_get && req->map->action != http_head )
+		return 0;
+	conn->meta_detached = -1;
+	if( meta_notify_fd >= 0 ){
+		if( ( path = wrangle_path( req ) ) == NULL )
+			return 0;
+		if( meta_find( path, catnip_hash( path, strlen( path ), 0, 0 ) ) != NULL )
+			return 0;
+		++stats.meta_misses;
+		// watched before the open, as in meta_lookup()
+		if( meta_watch( path, ( slash = strrchr( path, '/' ) ) != NULL ? slash - path + 1 : 0 ) == 0 )
+			conn->meta_detached = 1;
+	}
+	conn->meta_generation = meta_generation;
+	conn->job.run = conn_run;
+	conn->job.done = conn_offloaded;
+	conn->job.arg = conn;
+	conn->offloaded = 1;
+	pool_submit( &conn->job );
+	return 1;
+}
+
+// on a pool thread: the action, with the request to itself
+static void
+conn_run( struct catnip_job* job )
+{
+	struct catnip_conn* conn = job->arg;
+
+	meta_detached = conn->meta_detached;
+	dispatch_request( conn->req );
+	meta_detached = -1;
+}
+
+// back on the event loop: cache what the action opened, queue the response and carry on
+static void
+conn_offloaded( struct catnip_job* job, int epfd )
+{
+	struct catnip_conn* conn = job->arg;
+	struct http_request* req = conn->req;
+
+	conn->offloaded = 0;
+	if( req->doc_meta != NULL && conn->meta_detached > 0 ) // the document's entry, even when a variant of it is going out
+		meta_adopt( req->doc_meta->parent != NULL ? req->doc_meta->parent : req->doc_meta, conn->meta_generation );
+	if( req->doc_fd < 0 )
+		req->doc_meta = NULL; // HEAD took no reference of its own
+	conn_queue( conn );
+	if( req->keep_alive )
+		next_http_request( req );
+	else
+		conn->closing = 1;
+	if( conn->dropped )
+		conn_close( -1, conn );
+	else
+		conn_process( epfd, conn );
+}
+
+/*
+ * conn_inline copies a small document (or range of one) the content cache
+ * holds into out right behind its head, so it needs no iovec or sendfile()
+ * of its own. one that is not in memory (-C 0, or over budget) is not read
+ * here: a pread() on the event loop would wait on the disk. returns -1 and
+ * leaves out as it was, and the document goes out like any other, by the
+ * ring's own reads or, for epoll, sendfile() (which can still wait on a
+ * cold page; the pool, -T, is what keeps the opening reads off the loop).
+ */
+static int
+conn_inline( struct catnip_conn* conn, struct http_request* req, off_t offset, size_t size )
+{
+	if( req->doc_meta == NULL || req->doc_meta->data == NULL )
+		return -1;
+	buffer_append( &conn->out, req->doc_meta->data + offset, size );
+	return 0;
+}
+
+/*
+ * conn_flush pushes queued output without blocking. heads, in-memory
+ * bodies and the heads after them are gathered into one sendmsg(); when
+ * that stops at a document sendfile() must send, MSG_MORE holds the head
+ * back so it leaves in the same segment as the start of the document.
+ * returns 0 when everything is out, 1 when the socket is full, -1 on error.
+ */
+static int
+conn_flush( struct catnip_conn* conn )
+{
+	struct iovec iov[CATNIP_IOV_MAX];
+	struct msghdr msg;
+	struct catnip_doc* doc;
+	int niov, more;
+	ssize_t n;
+
+	for( ;; ){
+		if( ( niov = conn_gather( conn, iov, &more ) ) > 0 ){
+			memset( &msg, 0, sizeof( msg ) );
+			msg.msg_iov = iov;
+			msg.msg_iovlen = niov;
+			if( ( n = sendmsg( conn->fd, &msg, more ? MSG_MORE : 0 ) ) < 0 ){
+				if( errno == EINTR )
+					continue;
+				return errno == EAGAIN || errno == EWOULDBLOCK ? 1 : -1;
+			}
+			conn_consume( conn, n );
+			continue;
+		}
+		if( ( doc = conn->docs ) == NULL )
+			break;
+		while( doc->data == NULL && doc->remaining > 0 ){
+			if( ( n = sendfile( conn->fd, doc->fd, &doc->offset, doc->remaining ) ) < 0 ){
+				if( errno == EINTR )
+					continue;
+				return errno == EAGAIN || errno == EWOULDBLOCK ? 1 : -1;
+			}
+			if( n == 0 )
+				return -1; // document shrank under us, cannot keep our Content-Length promise
+			doc->remaining -= n;
+		}
+		conn_pop_doc( conn ); // sent, or an empty one nothing was gathered for
+	}
+	conn->out.off = conn->out.len = 0; // all gone, start the buffer over
+	return 0;
+}
+
+/*
+ * conn_gather points iov (CATNIP_IOV_MAX of them) at what can go out in
+ * one sendmsg(), up to the first document that has to come from its fd;
+ * more says there is one. returns the count, 0 when the front is such a
+ * document, or an empty one, or there is nothing left at all.
+ */
+static int
+conn_gather( struct catnip_conn* conn, struct iovec* iov, int* more )
+{
+	struct catnip_doc* doc;
+	size_t upto, pos = conn->out.off;
+	int niov = 0;
+
+	*more = 0;
+	for( doc = conn->docs; niov < CATNIP_IOV_MAX - 1; doc = doc->next ){
+		upto = doc != NULL ? doc->at : conn->out.len;
+		if( pos < upto ){
+			iov[niov].iov_base = conn->out.data + pos;
+			iov[niov++].iov_len = upto - pos;
+		}
+		pos = upto;
+		if( doc == NULL )
+			break;
+		if( doc->data == NULL ){
+			*more = 1; // sendfile follows
+			break;
+		}
+		if( doc->remaining > 0 ){
+			iov[niov].iov_base = doc->data + doc->offset;
+			iov[niov++].iov_len = doc->remaining;
+		}
+		if( doc->gzip != NULL )
+			break; // its next chunk comes before anything behind it
+	}
+	return niov;
+}
+
+// conn_consume accounts for n bytes of what conn_gather() gathered having gone out
+static void
+conn_consume( struct catnip_conn* conn, size_t n )
+{
+	struct catnip_doc* doc;
+	size_t upto, k;
+
+	for( ;; ){
+		upto = ( doc = conn->docs ) != NULL ? doc->at : conn->out.len;
+		k = upto - conn->out.off < n ? upto - conn->out.off : n;
+		conn->out.off += k;
+		n -= k;
+		if( conn->out.off < upto || doc == NULL || doc->data == NULL )
+			return;
+		k = (size_t)doc->remaining < n ? (size_t)doc->remaining : n;
+		doc->offset += k;
+		doc->remaining -= k;
+		n -= k;
+		if( doc->remaining > 0 )
+			return;
+		conn_pop_doc( conn );
+	}
+}
+
+/*
+ * conn_gzip_chunk points a gzipping doc at its next chunk, in memory like
+ * any cached document, so sendmsg() (or the ring) sends it the same way;
+ * conn_pop_doc() comes back here each time one has gone. returns 0 once
+ * the last chunk has.
+ */
+static int
+conn_gzip_chunk( struct catnip_conn* conn, struct catnip_doc* doc )
+{
+	int res = gzip_next( doc->gzip );
+
+	doc->data = doc->gzip->chunk;
+	doc->offset = 0;
+	doc->remaining = res > 0 ? doc->gzip->chunk_len : 0;
+	if( res < 0 ){
+		warnx( "fd %d: document shrank while gzipping it", conn->fd );
+		conn->closing = 1; // the body has no last chunk, the client can tell
+	}
+	return res > 0;
+}
+
+static void
+conn_pop_doc( struct catnip_conn* conn )
+{
+	struct catnip_doc* doc = conn->docs;
+
+	if( doc->gzip != NULL ){
+		if( conn_gzip_chunk( conn, doc ) )
+			return; // not done, the same doc goes on with its next chunk
+		gzip_free( doc->gzip );
+		doc->gzip = NULL;
+	}
+	release_doc( doc->fd, doc->meta );
+	if( ( conn->docs = doc->next ) == NULL )
+		conn->last_doc = NULL;
+	doc->next = doc_pool;
+	doc_pool = doc;
+}
+
+static void
+conn_wait( int epfd, struct catnip_conn* conn, uint32_t events )
+{
+	struct epoll_event ev;
+
+	if( conn->events == events )
+		return;
+	ev.events = conn->events = events;
+	ev.data.ptr = conn;
+	if( epoll_ctl( epfd, EPOLL_CTL_MOD, conn->fd, &ev ) < 0 )
+		conn_close( epfd, conn );
+}
+
+static void
+conn_close( int epfd, struct catnip_conn* conn )
+{
+	struct catnip_doc* doc;
+
+	if( epfd >= 0 )
+		epoll_ctl( epfd, EPOLL_CTL_DEL, conn->fd, NULL );
+	if( conn->offloaded ){ // a pool thread is using req, finish when it is done
+		conn->dropped = 1;
+		return;
+	}
+	close( conn->fd );
+	while( ( doc = conn->docs ) != NULL ){
+		conn->docs = doc->next;
+		if( doc->gzip != NULL )
+			gzip_free( doc->gzip );
+		doc->gzip = NULL;
+		release_doc( doc->fd, doc->meta );
+		doc->next = doc_pool;
+		doc_pool = doc;
+	}
+	free_http_request( conn->req );
+	if( conn->io != NULL ){
+		free( conn->io->bounce ); // only wanted by the odd big document
+		conn->io->bounce = NULL;
+	}
+	if( conn_pool_count < CATNIP_POOL_MAX && conn->out.cap <= CATNIP_LINGER_LIMIT ){
+		conn->next_free = conn_pool;
+		conn_pool = conn;
+		++conn_pool_count;
+		return;
+	}
+	free( conn->out.data );
+	free( conn->io );
+	free( conn );
+}
+
+/*
+ * cn -l port with an io_uring: the same connections, parser, actions and
+ * caches as the epoll loop above, but every accept, recv and send goes
+ * through one ring, and so does the disk. a GET or HEAD the metadata cache
+ * has not seen opens, stats and reads its document with openat, statx and
+ * read on the ring, while the other connections carry on; the entry goes
+ * in the cache and the action then finds everything it wants in memory.
+ * documents too big to keep (-M) are read a chunk at a time into a bounce
+ * buffer and sent from there. each pass round the loop is one
+ * io_uring_enter() submitting whatever the last completions queued up and
+ * waiting for the next ones.
+ *
+ * the raw system calls and <linux/io_uring.h>, no liburing. serve_http()
+ * sets the ring up when -E allows and the kernel has one with every
+ * operation we use, else it carries on with epoll.
+ */
+#define CATNIP_URING_ENTRIES 256
+#define CATNIP_URING_BOUNCE (128 * 1024)	// chunk of a document sent from its fd
+
+// the low bits of user_data say what completed, the rest is the connection
+enum uring_op {
+	URING_ACCEPT = 1, // no connection
+	URING_NOTIFY, // inotify readable, no connection
+	URING_RECV,
+	URING_SENDMSG,
+	URING_OPEN,
+	URING_STATX,
+	URING_READ, // the document, into meta->data
+	URING_CHUNK_READ, // the next bounce buffer full
+	URING_CHUNK_SEND,
+	URING_OP_MASK = 15 // connections come from malloc, aligned well past this
+};
+
+static struct catnip_uring {
+	int	fd;
+	unsigned *sq_head, *sq_tail, *sq_array, sq_mask, sq_entries;
+	unsigned *cq_head, *cq_tail, cq_mask;
+	struct io_uring_sqe* sqes;
+	struct io_uring_cqe* cqes;
+	unsigned unsubmitted; // sqes queued since the last io_uring_enter()
+} uring = { .fd = -1 };
+
+static int uring_listen_fd, uring_notify_fd;
+static char* uring_webroot;
+static int uring_usefork;
+
+static void uring_complete( struct catnip_conn* conn, int op, int res );
+static void uring_process( struct catnip_conn* conn );
+static int uring_lookup( struct catnip_conn* conn );
+static void uring_looked( struct catnip_conn* conn, int error );
+static void uring_recv( struct catnip_conn* conn );
+static void uring_send( struct catnip_conn* conn );
+static void uring_close( struct catnip_conn* conn );
+
+static int
+uring_enter( unsigned submit, unsigned wait )
+{
+	int n;
+
+	n = syscall( SYS_io_uring_enter, uring.fd, submit, wait, wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0 );
+	if( n >= 0 ){
+		++stats.uring_enters;
+		stats.uring_sqes += n;
+		uring.unsubmitted -= n;
+	}
+	return n;
+}
+
+/*
+ * uring_setup makes the ring and maps it in. returns -1, leaving the
+ * listener to epoll, when the kernel says no or lacks an operation.
+ */
+static int
+uring_setup( void )
+{
+	static const int needed[] = { IORING_OP_ACCEPT, IORING_OP_POLL_ADD, IORING_OP_RECV, IORING_OP_SENDMSG,
+		IORING_OP_SEND, IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READ };
+	struct io_uring_params p;
+	struct io_uring_probe* probe;
+	size_t sq_size, cq_size;
+	char *sq, *cq;
+	int fd;
+
+	memset( &p, 0, sizeof( p ) );
+	if( ( fd = syscall( SYS_io_uring_setup, CATNIP_URING_ENTRIES, &p ) ) < 0 ){
+		if( verbosity >= 1 )warn( "io_uring_setup" );
+		return -1;
+	}
+	if( !( p.features & IORING_FEAT_NODROP ) ){ // completions must not be lost when we fall behind
+		close( fd );
+		return -1;
+	}
+	if( ( probe = catnip_calloc( 1, sizeof( *probe ) + 256 * sizeof( struct io_uring_probe_op ) ) ) == NULL
+	 || syscall( SYS_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256 ) < 0 ){
+		free( probe );
+		close( fd );
+		return -1;
+	}
+	for( size_t i = 0; i < sizeof( needed ) / sizeof( needed[0] ); ++i )
+		if( needed[i] > probe->last_op || !( probe->ops[needed[i]].flags & IO_URING_OP_SUPPORTED ) ){
+			if( verbosity >= 1 )fprintf( stderr, "catnip: io_uring lacks op %d\n", needed[i] );
+			free( probe );
+			close( fd );
+			return -1;
+		}
+	free( probe );
+	sq_size = p.sq_off.array + p.sq_entries * sizeof( unsigned );
+	cq_size = p.cq_off.cqes + p.cq_entries * sizeof( struct io_uring_cqe );
+	if( p.features & IORING_FEAT_SINGLE_MMAP )
+		sq_size = cq_size = sq_size > cq_size ? sq_size : cq_size;
+	sq = mmap( NULL, sq_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_SQ_RING );
+	if( sq == MAP_FAILED )
+		err(1, "io_uring mmap");
+	if( p.features & IORING_FEAT_SINGLE_MMAP )
+		cq = sq;
+	else if( ( cq = mmap( NULL, cq_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_CQ_RING ) ) == MAP_FAILED )
+		err(1, "io_uring mmap");
+	uring.sqes = mmap( NULL, p.sq_entries * sizeof( struct io_uring_sqe ), PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_SQES );
+	if( uring.sqes == MAP_FAILED )
+		err(1, "io_uring mmap");
+	uring.fd = fd;
+	uring.sq_head = (unsigned*)( sq + p.sq_off.head );
+	uring.sq_tail = (unsigned*)( sq + p.sq_off.tail );
+	uring.sq_array = (unsigned*)( sq + p.sq_off.array );
+	uring.sq_mask = *(unsigned*)( sq + p.sq_off.ring_mask );
+	uring.sq_entries = p.sq_entries;
+	uring.cq_head = (unsigned*)( cq + p.cq_off.head );
+	uring.cq_tail = (unsigned*)( cq + p.cq_off.tail );
+	uring.cq_mask = *(unsigned*)( cq + p.cq_off.ring_mask );
+	uring.cqes = (struct io_uring_cqe*)( cq + p.cq_off.cqes );
+	return 0;
+}
+
+/*
+ * uring_sqe hands out the next submission slot, cleared and tagged for
+ * conn and op. the kernel only looks at it in the next uring_enter(), so
+ * it is published now and filled in by the caller.
+ */
+static struct io_uring_sqe*
+uring_sqe( struct catnip_conn* conn, enum uring_op op, int opcode, int fd )
+{
+	struct io_uring_sqe* sqe;
+	unsigned tail = *uring.sq_tail;
+
+	while( tail - __atomic_load_n( uring.sq_head, __ATOMIC_ACQUIRE ) >= uring.sq_entries )
+		if( uring_enter( uring.unsubmitted, 0 ) < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY )
+			err(1, "io_uring_enter");
+	sqe = &uring.sqes[tail & uring.sq_mask];
+	memset( sqe, 0, sizeof( *sqe ) );
+	sqe->opcode = opcode;
+	sqe->fd = fd;
+	sqe->user_data = (uintptr_t)conn | op;
+	uring.sq_array[tail & uring.sq_mask] = tail & uring.sq_mask;
+	__atomic_store_n( uring.sq_tail, tail + 1, __ATOMIC_RELEASE );
+	++uring.unsubmitted;
+	if( conn != NULL )
+		++conn->inflight;
+	return sqe;
+}
+
+static void
+uring_accept( void )
+{
+	struct io_uring_sqe* sqe = uring_sqe( NULL, URING_ACCEPT, IORING_OP_ACCEPT, uring_listen_fd );
+	sqe->accept_flags = SOCK_NONBLOCK|SOCK_CLOEXEC;
+}
+
+static void
+uring_notify( void )
+{
+	struct io_uring_sqe* sqe = uring_sqe( NULL, URING_NOTIFY, IORING_OP_POLL_ADD, uring_notify_fd );
+	sqe->poll32_events = POLLIN;
+}
+
+static int
+serve_uring( char* port, int listen_fd, char* webroot, int usefork )
+{
+	struct sigaction sa;
+	struct io_uring_cqe cqe;
+	unsigned head;
+
+	memset( &sa, 0, sizeof( sa ) );
+	sa.sa_handler = catch_usr1; // no SA_RESTART, io_uring_enter() comes back for print_stats()
+	sigaction( SIGUSR1, &sa, NULL );
+	uring_listen_fd = listen_fd;
+	uring_webroot = webroot;
+	uring_usefork = usefork;
+	uring_accept();
+	if( ( uring_notify_fd = meta_cache_init( webroot ) ) >= 0 )
+		uring_notify();
+	if( verbosity >= 0 )fprintf( stderr, "catnip: listening on port %s with io_uring, webroot %s\n", port, webroot );
+
+	for( ;; ){
+		if( uring_enter( uring.unsubmitted, 1 ) < 0 ){
+			if( errno == EINTR ){
+				if( stats_wanted ){
+					stats_wanted = 0;
+					print_stats( stderr );
+				}
+				continue;
+			}
+			if( errno != EAGAIN && errno != EBUSY ) // out of resources for now, reap and go again
+				err(1, "io_uring_enter");
+		}
+		for( head = *uring.cq_head; head != __atomic_load_n( uring.cq_tail, __ATOMIC_ACQUIRE ); ){
+			cqe = uring.cqes[head & uring.cq_mask];
+			__atomic_store_n( uring.cq_head, ++head, __ATOMIC_RELEASE );
+			uring_complete( (struct catnip_conn*)(uintptr_t)( cqe.user_data & ~(uint64_t)URING_OP_MASK ),
+				cqe.user_data & URING_OP_MASK, cqe.res );
+		}
+	}
+	/* NOTREACHED */
+	return 0;
+}
+
+static void
+uring_complete( struct catnip_conn* conn, int op, int res )
+{
+	struct catnip_ring_io* io;
+	struct catnip_meta* meta;
+	struct catnip_doc* doc;
+	struct io_uring_sqe* sqe;
+
+	if( op == URING_ACCEPT ){
+		if( res >= 0 && ( conn = conn_new( res, uring_webroot, uring_usefork ) ) != NULL )
+			uring_recv( conn );
+		else if( res < 0 && res != -EAGAIN && res != -EINTR && res != -ECONNABORTED ){
+			errno = -res;
+			warn( "accept" );
+		}
+		uring_accept();
+		return;
+	}
+	if( op == URING_NOTIFY ){
+		meta_changed( uring_notify_fd );
+		uring_notify();
+		return;
+	}
+	--conn->inflight;
+	io = conn->io;
+	meta = conn->opening;
+	if( conn->dropped ){ // uring_close() was waiting for this
+		if( op == URING_OPEN && res >= 0 )
+			meta->fd = res;
+		if( meta != NULL && ( op == URING_OPEN || op == URING_STATX || op == URING_READ ) ){
+			meta_release( meta );
+			conn->opening = NULL;
+		}
+		if( conn->inflight == 0 )
+			conn_close( -1, conn );
+		return;
+	}
+	switch( op ){
+	case URING_RECV:
+		conn->recving = 0;
+		if( conn->lingering ){ // as conn_readable()
+			if( res <= 0 || ( conn->lingering += res ) > CATNIP_LINGER_LIMIT )
+				uring_close( conn );
+			else
+				uring_recv( conn );
+			return;
+		}
+		if( res < 0 ){
+			if( res == -EINTR || res == -EAGAIN )
+				uring_recv( conn );
+			else
+				uring_close( conn );
+			return;
+		}
+		if( res == 0 )
+			conn->eof = 1;
+		else if( verbosity >= 1 )fprintf( stderr, "read %d bytes on fd %d\n", res, conn->fd );
+		conn->req->nr += res;
+		uring_process( conn );
+		return;
+	case URING_SENDMSG:
+		conn->sending = 0;
+		if( res < 0 && res != -EINTR && res != -EAGAIN ){
+			uring_close( conn );
+			return;
+		}
+		if( res > 0 )
+			conn_consume( conn, res );
+		uring_process( conn );
+		return;
+	case URING_CHUNK_READ:
+		if( res <= 0 ){ // document shrank under us, cannot keep our Content-Length promise
+			uring_close( conn );
+			return;
+		}
+		io->bounce_len = res;
+		io->bounce_off = 0;
+		res = 0;
+		/* FALLTHROUGH */
+	case URING_CHUNK_SEND:
+		if( res < 0 && res != -EINTR && res != -EAGAIN ){
+			uring_close( conn );
+			return;
+		}
+		doc = conn->docs;
+		if( res > 0 ){
+			io->bounce_off += res;
+			doc->offset += res;
+			doc->remaining -= res;
+		}
+		if( io->bounce_off < io->bounce_len ){
+			sqe = uring_sqe( conn, URING_CHUNK_SEND, IORING_OP_SEND, conn->fd );
+			sqe->addr = (uintptr_t)( io->bounce + io->bounce_off );
+			sqe->len = io->bounce_len - io->bounce_off;
+			sqe->msg_flags = doc->remaining > (off_t)sqe->len ? MSG_MORE : 0;
+			return;
+		}
+		conn->sending = 0;
+		if( doc->remaining == 0 )
+			conn_pop_doc( conn );
+		uring_process( conn );
+		return;
+	case URING_OPEN:
+		if( res < 0 ){
+			uring_looked( conn, -res ); // http_head() will say what is wrong with it
+			return;
+		}
+		meta->fd = res;
+		sqe = uring_sqe( conn, URING_STATX, IORING_OP_STATX, res );
+		sqe->addr = (uintptr_t)"";
+		sqe->statx_flags = AT_EMPTY_PATH;
+		sqe->len = STATX_BASIC_STATS;
+		sqe->off = (uintptr_t)&io->stx;
+		return;
+	case URING_STATX:
+		if( res < 0 || !S_ISREG( io->stx.stx_mode ) ){
+			uring_looked( conn, res < 0 ? -res : ENOENT ); // no document there
+			return;
+		}
+		meta->st.st_dev = makedev( io->stx.stx_dev_major, io->stx.stx_dev_minor );
+		meta->st.st_ino = io->stx.stx_ino;
+		meta->st.st_mode = io->stx.stx_mode;
+		meta->st.st_nlink = io->stx.stx_nlink;
+		meta->st.st_uid = io->stx.stx_uid;
+		meta->st.st_gid = io->stx.stx_gid;
+		meta->st.st_size = io->stx.stx_size;
+		meta->st.st_blksize = io->stx.stx_blksize;
+		meta->st.st_blocks = io->stx.stx_blocks;
+		meta->st.st_mtim.tv_sec = io->stx.stx_mtime.tv_sec;
+		meta->st.st_mtim.tv_nsec = io->stx.stx_mtime.tv_nsec;
+		meta->st.st_ctim.tv_sec = io->stx.stx_ctime.tv_sec;
+		meta->st.st_ctim.tv_nsec = io->stx.stx_ctime.tv_nsec;
+		meta->st.st_atim.tv_sec = io->stx.stx_atime.tv_sec;
+		meta->st.st_atim.tv_nsec = io->stx.stx_atime.tv_nsec;
+		meta_describe( meta );
+		// a GET for one meta_content() would keep: read it in now, on the ring
+		if( conn->req->map->action == http_get && meta->st.st_size > 0
+		 && (size_t)meta->st.st_size <= content_max && (size_t)meta->st.st_size <= content_budget
+		 && ( meta->data = catnip_malloc( meta->st.st_size ) ) != NULL ){
+			sqe = uring_sqe( conn, URING_READ, IORING_OP_READ, meta->fd );
+			sqe->addr = (uintptr_t)meta->data;
+			sqe->len = meta->st.st_size;
+			sqe->off = 0;
+			return;
+		}
+		uring_looked( conn, 0 );
+		return;
+	case URING_READ:
+		if( res != meta->st.st_size ){ // short, leave it to the bounce buffer
+			free( meta->data );
+			meta->data = NULL;
+		}
+		uring_looked( conn, 0 );
+		return;
+	}
+}
+
+/*
+ * uring_process is conn_process() for the ring: answer what is buffered,
+ * then send. it reads again only once everything has gone out, so a
+ * pipelining client cannot run us out of memory here either.
+ */
+static void
+uring_process( struct catnip_conn* conn )
+{
+	struct http_request* req = conn->req;
+
+	while( !conn->closing && conn->opening == NULL ){
+		if( req->body_pending > 0 ){ // answered already, echoing the body
+			if( conn_echo( conn ) )
+				break; // wait for the rest
+		}
+		else{
+			if( parse_http_request( req ) == PARSE_NEED_MORE )
+				break; // wait for the rest
+			if( uring_lookup( conn ) )
+				break; // uring_looked() carries on
+			conn_respond( conn );
+			if( req->body_pending > 0 )
+				continue; // see conn_echo()
+		}
+		if( req->keep_alive )
+			next_http_request( req );
+		else
+			conn->closing = 1;
+	}
+	if( conn->eof && !conn->closing && conn->opening == NULL ){
+		if( req->nr > 0 && verbosity >= 1 )fprintf( stderr, "catnip: fd %d hung up mid request\n", conn->fd );
+		conn->closing = 1;
+	}
+	uring_send( conn );
+	if( conn->sending || conn->recving || conn->opening != NULL )
+		return;
+	if( !conn->closing )
+		uring_recv( conn );
+	else if( conn->eof || shutdown( conn->fd, SHUT_WR ) < 0 )
+		uring_close( conn );
+	else{
+		conn->lingering = 1; // half closed, see uring_complete()
+		uring_recv( conn );
+	}
+}
+
+/*
+ * uring_lookup starts openat, statx and (for a GET) read for a document
+ * the metadata cache has not seen, as conn_offload() does with the pool.
+ * returns 1 if it did; the request waits for uring_looked().
+ */
+static int
+uring_lookup( struct catnip_conn* conn )
+{
+	struct http_request* req = conn->req;
+	struct io_uring_sqe* sqe;
+	struct catnip_meta* meta;
+	char *path, *slash;
+
+	if( meta_notify_fd < 0 || req->e || req->state != WANT_BODY || req->map == NULL )
+		return 0;
+	if( req->map->action != http_get && req->map->action != http_head )
+		return 0;
+	if( ( path = wrangle_path( req ) ) == NULL )
+		return 0;
+	if( meta_find( path, catnip_hash( path, strlen( path ), 0, 0 ) ) != NULL )
+		return 0;
+	++stats.meta_misses;
+	if( meta_watch( path, ( slash = strrchr( path, '/' ) ) != NULL ? slash - path + 1 : 0 ) < 0 )
+		return 0;
+	if( ( meta = meta_new( path ) ) == NULL )
+		return 0;
+	if( conn->io == NULL && ( conn->io = catnip_calloc( 1, sizeof( struct catnip_ring_io ) ) ) == NULL ){
+		meta_release( meta );
+		return 0;
+	}
+	conn->opening = meta;
+	conn->meta_generation = meta_generation;
+	sqe = uring_sqe( conn, URING_OPEN, IORING_OP_OPENAT, AT_FDCWD );
+	sqe->addr = (uintptr_t)meta->path;
+	sqe->open_flags = O_RDONLY|O_CLOEXEC;
+	return 1;
+}
+
+/*
+ * uring_looked: the lookup is over (error is the errno it failed with, or
+ * 0), cache what it found and answer the request from that, never from a
+ * second, blocking lookup of the path. an entry meta_adopt() would not
+ * take (inotify spoke up meanwhile) still answers this request, outside
+ * the cache's accounts, as one from the pool would.
+ */
+static void
+uring_looked( struct catnip_conn* conn, int error )
+{
+	struct http_request* req = conn->req;
+	struct catnip_meta* meta = conn->opening;
+
+	conn->opening = NULL;
+	if( error == 0 ){
+		++meta->refs; // ours while we answer from it, cached or not
+		meta_adopt( meta, conn->meta_generation );
+		if( ( meta_looked = meta_find( meta->path, meta->hash ) ) == NULL ){
+			meta_looked = meta;
+			meta_detached = -1;
+		}
+	}
+	else{
+		meta_release( meta );
+		req->doc_errno = error;
+		meta_detached = -1; // meta_lookup() finds nothing, and does not look
+	}
+	conn_respond( conn );
+	meta_looked = NULL;
+	meta_detached = 0;
+	if( error == 0 ){
+		if( req->doc_fd < 0 )
+			req->doc_meta = NULL; // HEAD took no reference of its own
+		meta_release( meta );
+	}
+	if( req->keep_alive )
+		next_http_request( req );
+	else
+		conn->closing = 1;
+	uring_process( conn );
+}
+
+static void
+uring_recv( struct catnip_conn* conn )
+{
+	struct http_request* req = conn->req;
+	struct io_uring_sqe* sqe;
+
+	if( conn->recving )
+		return;
+	conn->recving = 1;
+	sqe = uring_sqe( conn, URING_RECV, IORING_OP_RECV, conn->fd );
+	if( conn->lingering ){ // just to throw away
+		sqe->addr = (uintptr_t)req->buf;
+		sqe->len = req->bsize;
+	}
+	else{ // the parser always leaves room for the next read
+		sqe->addr = (uintptr_t)( req->buf + req->nr );
+		sqe->len = req->bsize - req->nr;
+	}
+}
+
+/*
+ * uring_send starts the next send when none is in flight: a sendmsg of
+ * what conn_gather() finds, or the next chunk of a document at the front
+ * that has to come from its fd, read into the bounce buffer first.
+ */
+static void
+uring_send( struct catnip_conn* conn )
+{
+	struct catnip_ring_io* io;
+	struct catnip_doc* doc;
+	struct io_uring_sqe* sqe;
+	int niov, more;
+
+	if( conn->sending )
+		return;
+	if( ( io = conn->io ) == NULL && ( io = conn->io = catnip_calloc( 1, sizeof( struct catnip_ring_io ) ) ) == NULL )
+		err(1, "connection");
+	for( ;; ){
+		if( ( niov = conn_gather( conn, io->iov, &more ) ) > 0 ){
+			memset( &io->msg, 0, sizeof( io->msg ) );
+			io->msg.msg_iov = io->iov;
+			io->msg.msg_iovlen = niov;
+			sqe = uring_sqe( conn, URING_SENDMSG, IORING_OP_SENDMSG, conn->fd );
+			sqe->addr = (uintptr_t)&io->msg;
+			sqe->msg_flags = more ? MSG_MORE : 0;
+			conn->sending = 1;
+			return;
+		}
+		if( ( doc = conn->docs ) == NULL ){
+			conn->out.off = conn->out.len = 0; // all gone, start the buffer over
+			return;
+		}
+		if( doc->data != NULL || doc->remaining == 0 ){
+			conn_pop_doc( conn );
+			continue;
+		}
+		if( io->bounce == NULL && ( io->bounce = catnip_malloc( CATNIP_URING_BOUNCE ) ) == NULL )
+			err(1, "bounce");
+		sqe = uring_sqe( conn, URING_CHUNK_READ, IORING_OP_READ, doc->fd );
+		sqe->addr = (uintptr_t)io->bounce;
+		sqe->len = doc->remaining < CATNIP_URING_BOUNCE ? doc->remaining : CATNIP_URING_BOUNCE;
+		sqe->off = doc->offset;
+		conn->sending = 1;
+		return;
+	}
+}
+
+/*
+ * uring_close closes now if the ring holds nothing of ours, else shuts the
+ * socket down so a waiting recv comes back, and leaves the rest to
+ * uring_complete() once the last operation has.
+ */
+static void
+uring_close( struct catnip_conn* conn )
+{
+	if( conn->inflight == 0 ){
+		conn_close( -1, conn );
+		return;
+	}
+	if( !conn->dropped ){
+		conn->dropped = 1;
+		shutdown( conn->fd, SHUT_RDWR );
+	}
+}
+
+/*
+ * supervise_pipelines (cn -p N -l port) runs the kc | nc | cn pipeline
+ * N at a time instead of the epoll listener. each slot is a child that
+ * gets its own private directory for the kitty marker, head and body
+ * (so .kc, response.http and body no longer collide), starts its kc
+ * before any client shows up, and then waits in accept() on the shared
+ * listener. the slot plays nc: it reads the request straight off the
+ * socket like cn always has, nips kc, and splices what kc cats back out
+ * to the client. one request per slot, as with nc -l; the supervisor
+ * reaps each finished slot and starts a fresh one.
+ */
+#define CATNIP_KC_NAP "86400"	// kc -w: a slot may wait a long while for its client
+
+static pid_t spawn_kc( char* kc, char* kitty, char* head, char* body, int out );
+static void run_pipeline_slot( int listen_fd, char* kc, char* webroot, int usefork );
+
+static int
+supervise_pipelines( char* port, int n, char* kc, char* webroot, int usefork )
+{
+	int listen_fd, status, running = 0;
+	pid_t pid;
+
+	signal( SIGPIPE, SIG_IGN );
+	listen_fd = listen_on( port );
+	fcntl( listen_fd, F_SETFL, fcntl( listen_fd, F_GETFL ) & ~O_NONBLOCK ); // slots block in accept()
+	if( verbosity >= 0 )fprintf( stderr, "catnip: %d pipelines on port %s, webroot %s, kc %s\n", n, port, webroot, kc );
+	for( ;; ){
+		while( running < n ){
+			switch( pid = fork() ){
+			case -1:
+				warn( "fork" );
+				sleep( 1 ); // and try again
+				continue;
+			case 0:
+				prctl( PR_SET_PDEATHSIG, SIGTERM ); // slots go when the supervisor does
+				run_pipeline_slot( listen_fd, kc, webroot, usefork );
+				_exit( 0 ); /* NOTREACHED */
+			}
+			++running;
+		}
+		if( ( pid = wait( &status ) ) < 0 ){
+			if( errno == EINTR )
+				continue;
+			err(1, "wait");
+		}
+		--running;
+		if( verbosity >= 1 || !WIFEXITED( status ) || WEXITSTATUS( status ) != 0 )
+			fprintf( stderr, "catnip: pipeline %d done, status 0x%x\n", pid, status );
+	}
+	/* NOTREACHED */
+	return 0;
+}
+
+static void
+run_pipeline_slot( int listen_fd, char* kc, char* webroot, int usefork )
+{
+	char dir[] = "/tmp/catnip.XXXXXX";
+	char kitty[sizeof( dir ) + 16], head[sizeof( dir ) + 16], body[sizeof( dir ) + 16];
+	int p[2], fd, head_fd, body_fd, errors = 0;
+	pid_t kc_pid, nip_pid;
+	sigset_t nips;
+	ssize_t n;
+
+	if( mkdtemp( dir ) == NULL )
+		err(1, "mkdtemp");
+	snprintf( kitty, sizeof( kitty ), "%s/.kc", dir );
+	snprintf( head, sizeof( head ), "%s/response.http", dir );
+	snprintf( body, sizeof( body ), "%s/body", dir );
+	// kc is born with its nip signals blocked, so one sent before it is ready waits for it
+	sigemptyset( &nips );
+	sigaddset( &nips, KITTY_NIP_SIGNAL );
+	sigprocmask( SIG_BLOCK, &nips, NULL );
+	if( pipe( p ) < 0 )
+		err(1, "pipe");
+	kc_pid = spawn_kc( kc, kitty, head, body, p[1] );
+
+	while( ( fd = accept( listen_fd, NULL, NULL ) ) < 0 )
+		if( errno != EINTR && errno != ECONNABORTED )
+			err(1, "accept");
+	close( listen_fd );
+	if( waitpid( kc_pid, NULL, WNOHANG ) == kc_pid ){ // kc gave up waiting, take another
+		close( p[0] );
+		if( pipe( p ) < 0 )
+			err(1, "pipe");
+		kc_pid = spawn_kc( kc, kitty, head, body, p[1] );
+	}
+	close( p[1] );
+	if( verbosity >= 1 )fprintf( stderr, "catnip: pipeline %d in %s took fd %d, kc %d\n", getpid(), dir, fd, kc_pid );
+
+	// cn
+	if( ( head_fd = open( head, O_WRONLY|O_CREAT|O_TRUNC, 0600 ) ) < 0
+	 || ( body_fd = open( body, O_WRONLY|O_CREAT|O_TRUNC, 0600 ) ) < 0 )
+		err(1, "%s", dir);
+	parse_request( fd, head_fd, body_fd, webroot, usefork );
+	nip_pid = kc_pid; // in case its ring is not up yet
+	errors |= nip_kitty( kitty, &nip_pid, KITTY_NIP_SIGNAL, head, head_fd );
+	close( head_fd );
+	errors |= nip_kitty( kitty, &nip_pid, KITTY_NIP_SIGNAL, body, body_fd );
+	close( body_fd );
+
+	// nc, kc's side
+	while( ( n = splice( p[0], NULL, fd, NULL, 1 << 20, SPLICE_F_MOVE ) ) > 0 || ( n < 0 && errno == EINTR ) )
+		;
+	if( n < 0 ){ // not a socket splice can write to, copy it
+		char buf[64 * 1024];
+		ssize_t w;
+		while( ( n = read( p[0], buf, sizeof( buf ) ) ) > 0 )
+			for( char* q = buf; n > 0; n -= w, q += w )
+				if( ( w = write( fd, q, n ) ) < 0 ){
+					errors = 1;
+					n = 0;
+					break;
+				}
+	}
+	shutdown( fd, SHUT_WR );
+	close( fd );
+	close( p[0] );
+	waitpid( kc_pid, NULL, 0 );
+	unlink( head );
+	unlink( body );
+	unlink( kitty );
+	strcat( kitty, KITTY_RING_SUFFIX );
+	unlink( kitty );
+	rmdir( dir );
+	_exit( errors );
+}
+
+/*
+ * prefork_workers (cn -j N -l port) runs N copies of the epoll listener.
+ * each worker binds its own SO_REUSEPORT socket, so the kernel spreads
+ * connections over them with no shared accept queue to fight over, and
+ * each has its own request pools and caches. the master only restarts
+ * workers that die, optionally pins worker i to CPU i (-A), and passes
+ * SIGUSR1 along so every worker prints its stats.
+ */
+static pid_t start_worker( int i, int pin, char* port, char* webroot, int usefork );
+
+static int
+prefork_workers( char* port, int n, int pin, char* webroot, int usefork )
+{
+	pid_t* workers;
+	time_t* started;
+	int status, i, backoff;
+	pid_t pid;
+	struct sigaction sa;
+
+	if( ( workers = catnip_calloc( n, sizeof( pid_t ) ) ) == NULL
+	 || ( started = catnip_calloc( n, sizeof( time_t ) ) ) == NULL )
+		err(1, "workers");
+	reuseport = 1;
+	close( listen_on( port ) ); // fail here, not in every worker, if the port is taken
+	memset( &sa, 0, sizeof( sa ) );
+	sa.sa_handler = catch_usr1; // no SA_RESTART, wait() has to come back for it
+	sigaction( SIGUSR1, &sa, NULL );
+	if( verbosity >= 0 )fprintf( stderr, "catnip: %d workers on port %s%s\n", n, port, pin ? ", pinned" : "" );
+	for( i = 0; i < n; ++i ){
+		if( ( workers[i] = start_worker( i, pin, port, webroot, usefork ) ) < 0 )
+			err(1, "worker %d: fork", i); // the ones started go with us, see start_worker()
+		started[i] = time( NULL );
+	}
+	for( ;; ){
+		if( ( pid = wait( &status ) ) < 0 ){
+			if( errno != EINTR )
+				err(1, "wait");
+			if( stats_wanted ){
+				stats_wanted = 0;
+				for( i = 0; i < n; ++i )
+					if( workers[i] > 0 ) // never kill(-1, ...), that is everyone we can reach
+						kill( workers[i], SIGUSR1 );
+			}
+			continue;
+		}
+		for( i = 0; i < n && workers[i] != pid; ++i )
+			;
+		if( i == n )
+			continue; // not one of ours
+		fprintf( stderr, "catnip: worker %d (pid %d) died, status 0x%x, restarting\n", i, pid, status );
+		if( time( NULL ) - started[i] < 1 )
+			sleep( 1 ); // dying as fast as we start it, do not spin
+		workers[i] = 0; // an empty slot until the fork takes
+		for( backoff = 1; ( pid = start_worker( i, pin, port, webroot, usefork ) ) < 0; backoff = backoff < 32 ? 2 * backoff : backoff ){
+			warn( "worker %d: fork, trying again in %d s", i, backoff );
+			sleep( backoff );
+		}
+		workers[i] = pid;
+		started[i] = time( NULL );
+	}
+	/* NOTREACHED */
+	return 0;
+}
+
+// start_worker forks worker i; -1 (errno set) if it could not, the caller decides what then
+static pid_t
+start_worker( int i, int pin, char* port, char* webroot, int usefork )
+{
+	pid_t pid;
+
+	switch( pid = fork() ){
+	case -1:
+		break;
+	case 0:
+		prctl( PR_SET_PDEATHSIG, SIGTERM ); // workers go when the master does
+		if( pin ){
+			cpu_set_t cpus;
+			CPU_ZERO( &cpus );
+			CPU_SET( i % sysconf( _SC_NPROCESSORS_ONLN ), &cpus );
+			if( sched_setaffinity( 0, sizeof( cpus ), &cpus ) < 0 )
+				warn( "worker %d: pinning", i );
+		}
+		_exit( serve_http( port, webroot, usefork ) );
+	}
+	return pid;
+}
+
+// spawn_kc starts kc -k kitty -w CATNIP_KC_NAP head body, catting into out
+static pid_t
+spawn_kc( char* kc, char* kitty, char* head, char* body, int out )
+{
+	pid_t pid;
+
+	switch( pid = fork() ){
+	case -1:
+		err(1, "fork");
+	case 0:
+		prctl( PR_SET_PDEATHSIG, SIGKILL ); // kc holds its SIGTERM for a nip, this it cannot
+		if( dup2( out, STDOUT_FILENO ) < 0 )
+			_exit( 127 );
+		close( out );
+		execlp( kc, "kc", "-k", kitty, "-w", CATNIP_KC_NAP, head, body, (char*)NULL );
+		warn( "%s", kc );
+		_exit( 127 );
+	}
+	return pid;
+}
+
+#else
+
+static int
+serve_http( char* port, char* webroot, int usefork )
+{
+	warnx( "listening (-l %s) needs epoll, not available on this system", port );
+	return 1;
+}
+
+static int
+supervise_pipelines( char* port, int n, char* kc, char* webroot, int usefork )
+{
+	warnx( "pipelines (-p %d) are only supervised on Linux", n );
+	return 1;
+}
+
+static int
+prefork_workers( char* port, int n, int pin, char* webroot, int usefork )
+{
+	return serve_http( port, webroot, usefork ); // which says why not
+}
+
+// no listener, no cache
+static struct catnip_meta*
+meta_lookup( char* path )
+{
+	return NULL;
+}
+
+static void
+release_doc( int fd, struct catnip_meta* meta )
+{
+	close( fd );
+}
+
+static char*
+meta_content( struct catnip_meta* meta )
+{
+	return NULL;
+}
+
+#endif
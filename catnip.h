@@ -10,12 +10,73 @@ enum http_parse_state {
 	ERROR_STATE
 };
 
+enum http_parse_result {
+	PARSE_NEED_MORE, // read more into req->buf + req->nr, up to req->bsize, and call again
+	PARSE_DONE,	 // head and body are in, body_length is set
+	PARSE_ERROR	 // req->e (and req->message) say why
+};
+
+// bump allocator owning everything a request allocates; reset in O(1) when it is done
+struct catnip_arena {
+	char*	base;
+	size_t	size;
+	size_t	used;
+	size_t	spilled; // bytes that went to overflow chunks, folded into base at reset
+	struct catnip_arena_chunk* overflow;
+};
+
+struct key_value_pair {
+	char*	key;
+	char*	value;
+};
+
+#define CATNIP_RESPONSE_HEADERS 16 // room in the request itself, more come from the arena
+#define CATNIP_ENCODINGS 3 // precompressed siblings we look for, see catnip_encodings[]
+
+// what the listener remembers about a webroot document, see meta_lookup()
+struct catnip_meta {
+	char*	path; // wrangled path, the key
+	unsigned hash;
+	int	fd; // kept open, shared by every response sending it
+	int	refs; // one for the cache, one per response in flight
+	struct stat st;
+	char	content_length[24];
+	char	last_modified[64];
+	char	etag[64]; // quotes and all, see doc_etag()
+	char*	data; // whole document in memory, or NULL; see meta_content()
+	struct catnip_meta* variant[CATNIP_ENCODINGS]; // fresh precompressed siblings, one reference each
+	struct catnip_meta* parent; // a variant's original, which holds it; variants are never in the cache themselves
+	struct catnip_meta* hnext; // hash chain
+	struct catnip_meta *prev, *next; // most recently used first
+};
+
+// one satisfiable byte range of a document, see http_range()
+struct catnip_range {
+	off_t	offset;
+	off_t	length;
+};
+
+// a body gzipped on the fly, kept for the next request for it; see zcache_find()
+struct catnip_zvar {
+	char*	path; // with mtime and encoding, the key
+	struct timespec mtime;
+	const char* encoding;
+	unsigned hash;
+	int	refs; // one for the cache, one per response sending it
+	char*	data;
+	size_t	len;
+	struct catnip_zvar* hnext; // hash chain
+	struct catnip_zvar *prev, *next; // most recently used first
+};
+
 struct http_request {
 	char*	method;
 	char*	target;
 	char*	version;
 	char*	hk;
 	char*	hv;
+	enum http_header hid; // hk as looked up in catnip-words.h, or HEADER_UNKNOWN
+	char*	headers[HEADER_COUNT]; // values of the headers we know by name, NULL if absent
 	char*	server;
 	char*	port;
 	char*	body;
@@ -24,21 +85,143 @@ struct http_request {
 	char**	other_headers;
 	struct method_action* map; // method-action-pointer = map
 	struct version_map* vp; 
-	int	body_length; // req->nr - (p - req->buf) only assigned just before method call
+	off_t	body_length; // req->nr - (req->body - req->buf) only assigned just before method call
+	off_t	body_pending; // of Content-Length, still to come after body_length; a TRACE echoes it as it arrives
 	int	e; // error code
 	enum http_parse_state state;
+	// framing
+	off_t	content_length; // from the request headers, -1 when absent
+	int	keep_alive; // per http_versions[] default and any Connection: header
+	int	allow_keep_alive; // the listener can keep a connection, the pipeline cannot
 	// buffer allocation and population
 	ssize_t nr, np;
-	size_t bsize; // assumed header line maximum
+	size_t bsize; // grows as needed up to header_limit, then head plus Content-Length up to body_limit
 	char *buf;
 	// action context
 	char*	webroot; // webroot "kitty" or other
 	int	usefork; // use fork/chroot instead of path stripping
+	// response headers added by the action and dispatch_request(), copies in arena
+	struct key_value_pair* response_headers; // response_header_space, until that fills
+	int	response_header_count;
+	int	response_header_cap;
+	struct key_value_pair response_header_space[CATNIP_RESPONSE_HEADERS];
+	struct catnip_arena arena; // reset with the request
+	struct http_request* next_free; // request pool link
+	// response body staged by the action, emitted by write_http_body() or the server loop
+	int	doc_fd; // document to copy, or -1
+	struct catnip_meta* doc_meta; // cache entry doc_fd belongs to, or NULL when doc_fd is ours to close
+	char*	doc_path; // the file http_head() described, maybe a precompressed sibling, when uncached
+	int	doc_errno; // the io_uring lookup failed so already, http_head() answers from it, see uring_looked()
+	off_t	doc_length; // the whole document, even when only ranges of it go out
+	struct catnip_range* ranges; // what a 206 sends of doc_fd, in the arena; NULL sends it all
+	int	range_count;
+	char*	boundary; // multipart/byteranges, when range_count > 1
+	char*	range_type; // each part's Content-Type
+	struct catnip_zvar* zvar; // the variant cache's gzipped body, one reference, reply points into it
+	int	deflating; // doc_fd goes out gzipped as it is read, chunked, see gzip_next()
+	int	chunked; // reply goes out as a chunk, the last chunk once body_pending has followed it
+	char*	reply; // in-memory body, or NULL
+	size_t	reply_length;
 };
 
 struct method_action {
 	char* method;
-	int (*action)( int body_fd, struct http_request* req );
+	int (*action)( struct http_request* req );
+};
+
+// growable byte buffer, e.g. a response head on its way out
+struct catnip_buffer {
+	char*	data;
+	size_t	len; // bytes held
+	size_t	off; // bytes already written out
+	size_t	cap;
+};
+
+// counters, printed at exit with -v and on SIGUSR1 by the listener
+struct catnip_stats {
+	unsigned long requests;
+	unsigned long not_modified; // answered 304 from the validators alone
+	unsigned long mallocs; // malloc, calloc and realloc calls made by catnip_malloc() and friends
+	unsigned long pooled; // requests, connections and docs handed out again from a pool
+	unsigned long meta_hits;
+	unsigned long meta_misses;
+	unsigned long meta_invalidations; // entries dropped because inotify saw a change
+	unsigned long content_hits; // GETs answered from memory
+	unsigned long content_misses; // documents read in
+	unsigned long content_evictions; // documents dropped to stay within -C
+	size_t	content_bytes; // held right now
+	// the listener's thread pool, see pool_submit()
+	unsigned long pool_jobs; // handed to the pool
+	unsigned long pool_stolen; // taken by a thread from another thread's deque
+	unsigned long pool_depth_max; // most jobs ever waiting at once
+	unsigned long pool_depth_total; // summed at each submit, for the mean
+	unsigned long pool_depth; // waiting right now
+	// the io_uring backend, see serve_uring()
+	unsigned long uring_enters; // io_uring_enter() calls
+	unsigned long uring_sqes; // operations they submitted
+	// gzip on the fly (-z) and the variant cache (-Z), see zcache_find()
+	unsigned long gzip_streams; // documents gzipped as they went out
+	unsigned long zcache_hits; // gzipped bodies sent from the cache
+	unsigned long zcache_evictions; // dropped to stay within -Z
+	size_t	zcache_bytes; // held right now
+};
+
+/*
+ * work for the listener's thread pool: run() on a pool thread, where it
+ * may block; done() back on the event loop once it has, see pool_finished()
+ */
+struct catnip_job {
+	void	(*run)( struct catnip_job* job );
+	void	(*done)( struct catnip_job* job, int epfd );
+	void*	arg;
+	struct catnip_job* next; // finished list
+};
+
+// one pool thread's jobs: it takes the newest from the bottom, idle threads steal the oldest from the top
+struct catnip_deque {
+	pthread_mutex_t lock;
+	struct catnip_job** jobs; // ring of cap, power of two
+	size_t	top, bottom; // top <= bottom, both only ever grow
+	size_t	cap;
+	int	index;
+	pthread_t thread;
+};
+
+// a document queued to follow the first `at` bytes of a connection's out buffer
+struct catnip_doc {
+	int	fd;
+	off_t	offset;
+	off_t	remaining;
+	size_t	at;
+	struct catnip_meta* meta; // see http_request doc_meta
+	char*	data; // the document in memory (meta->data), else sendfile from fd
+	struct catnip_gzip* gzip; // or gzipping it, data being the chunk on its way, see conn_gzip_chunk()
+	struct catnip_doc* next;
+};
+
+// one client of the built-in listener (cn -l port)
+struct catnip_conn {
+	int	fd;
+	struct http_request* req; // the request being parsed; earlier ones are already answered
+	struct catnip_buffer out; // response heads and in-memory bodies, in request order
+	struct catnip_doc* docs; // documents interleaved with out, in request order
+	struct catnip_doc* last_doc;
+	uint32_t events; // what we are waiting on in epoll
+	int	eof; // client has finished sending
+	int	closing; // last response queued, close once everything has drained
+	size_t	lingering; // bytes discarded after our half close, waiting for the client's
+	struct catnip_job job; // the request handed to the pool, see conn_offload()
+	int	offloaded; // job is out, leave req alone until it is done
+	int	dropped; // closed while offloaded, freed once the job is back
+	unsigned meta_generation; // meta_changed() count when it went out
+	int	meta_detached; // whether the job may open an entry for the cache
+	// the io_uring backend, see serve_uring()
+	struct catnip_ring_io* io; // kept with the connection when it is pooled
+	int	inflight; // operations the ring holds for us; we are not freed until they are back
+	int	recving;
+	int	sending; // a sendmsg, or the read and sends of a document's next chunk
+	struct catnip_meta* opening; // entry being opened, stat'd and read in for the request
+	struct catnip_conn* next_free; // connection pool link
 };
 
 enum http_version { // singular
@@ -51,5 +234,6 @@ enum http_version { // singular
 struct version_map {
 	char* version;
 	enum http_version http_version;
+	int keep_alive; // persistent connection unless the client says Connection: close
 };
 
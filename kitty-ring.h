@@ -0,0 +1,106 @@
+/*
+ * the kitty rendezvous: how cn (catnip) tells kc (kittycat) a file is ready.
+ *
+ * the marker file kc creates (.kc or -k path) holds kc's PID as text, for
+ * cn and kill(1) to signal; that stays as it was. on Linux kc also creates
+ * the marker path plus KITTY_RING_SUFFIX, a small shared segment holding a
+ * single-producer, single-consumer ring of "ready" records. cn appends a
+ * record, bumps the futex word and wakes kc; kc takes one record per file
+ * it is about to cat. a cn that finds no ring signals the PID instead.
+ *
+ * records queue up, so a nip sent before kc gets around to waiting is not
+ * lost the way a signal landing before nanosleep() was.
+ *
+ * eventfd would need the two processes to share an fd, and kc | nc | cn are
+ * siblings that only share a path; a futex on the shared page needs nothing
+ * but the mapping.
+ */
+#ifndef KITTY_RING_H
+#define KITTY_RING_H
+
+#include <signal.h>
+
+/*
+ * without a ring, cn nips kc with this signal through sigqueue(), the value
+ * being which nip it is (1 head, 2 body). real-time signals queue, so two
+ * nips are two wakeups; kc blocks it and takes each one in sigtimedwait().
+ */
+#ifdef SIGRTMIN
+#define KITTY_NIP_SIGNAL SIGRTMIN
+#endif
+
+#ifdef __linux__
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#define KITTY_RING_SUFFIX ".ring"	// .kc.ring next to .kc
+#define KITTY_RING_MAGIC 0x6b697472	// "kitr", written last by kc once the ring is ready
+#define KITTY_RING_SLOTS 32		// power of two
+#define KITTY_READY_NAME 112
+
+// one file cn has finished writing
+struct kitty_ready {
+	char	name[KITTY_READY_NAME]; // as cn named it, for kc to check against its own
+	int64_t	size;
+	uint64_t seq; // counts from 1 over the life of the ring
+};
+
+struct kitty_ring {
+	uint32_t magic;
+	uint32_t futex; // bumped by cn after every record
+	uint32_t head; // next slot cn writes, only cn stores it
+	uint32_t tail; // next slot kc reads, only kc stores it
+	struct kitty_ready slot[KITTY_RING_SLOTS];
+};
+
+// cn: returns 0, or -1 when kc has fallen a whole ring behind
+static inline int
+kitty_ring_push( struct kitty_ring* ring, const char* name, int64_t size )
+{
+	uint32_t head = ring->head;
+	struct kitty_ready* r;
+
+	if( head - __atomic_load_n( &ring->tail, __ATOMIC_ACQUIRE ) >= KITTY_RING_SLOTS )
+		return -1;
+	r = &ring->slot[head & (KITTY_RING_SLOTS - 1)];
+	strncpy( r->name, name, sizeof( r->name ) - 1 );
+	r->name[sizeof( r->name ) - 1] = '\0';
+	r->size = size;
+	r->seq = head + 1;
+	__atomic_store_n( &ring->head, head + 1, __ATOMIC_RELEASE );
+	__atomic_add_fetch( &ring->futex, 1, __ATOMIC_RELEASE );
+	syscall( SYS_futex, &ring->futex, FUTEX_WAKE, 1, NULL, NULL, 0 );
+	return 0;
+}
+
+// kc: copies out the oldest record; returns 0, or -1 when there is none
+static inline int
+kitty_ring_pop( struct kitty_ring* ring, struct kitty_ready* ready )
+{
+	uint32_t tail = ring->tail;
+
+	if( tail == __atomic_load_n( &ring->head, __ATOMIC_ACQUIRE ) )
+		return -1;
+	*ready = ring->slot[tail & (KITTY_RING_SLOTS - 1)];
+	__atomic_store_n( &ring->tail, tail + 1, __ATOMIC_RELEASE );
+	return 0;
+}
+
+/*
+ * kc: sleeps until cn has pushed since `seen` was read from ring->futex,
+ * a signal arrives, or timeout runs out. returns futex(2)'s result.
+ */
+static inline long
+kitty_ring_wait( struct kitty_ring* ring, uint32_t seen, const struct timespec* timeout )
+{
+	return syscall( SYS_futex, &ring->futex, FUTEX_WAIT, seen, timeout, NULL, 0 );
+}
+
+#endif /* __linux__ */
+
+#endif /* KITTY_RING_H */
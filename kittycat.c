@@ -75,6 +75,10 @@ static char sccsid[] = "@(#)cat.c	8.2 (Berkeley) 4/27/95";
 // #include <sys/cdefs.h>
 static char fbsdid[] = "$FreeBSD: src/bin/cat/cat.c,v 1.32 2005/01/10 08:39:20 imp Exp $";
 
+#ifdef __linux__
+#define _GNU_SOURCE	// splice and copy_file_range for the zero-copy raw_cat paths
+#endif
+
 #include <sys/param.h>
 #include <sys/stat.h>
 #ifndef NO_UDOM_SUPPORT
@@ -94,9 +98,19 @@ static char fbsdid[] = "$FreeBSD: src/bin/cat/cat.c,v 1.32 2005/01/10 08:39:20 i
 #include <stddef.h>
 #include <signal.h>
 #include <time.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#include <sys/mman.h>	// kitty ring
+#include <pthread.h>	// read-ahead thread for the read/write loop
+#endif
+#ifdef __SSE2__
+#include <emmintrin.h>	// cook_scan()
+#endif
+#include "kitty-ring.h"
 
 int bflag, eflag, nflag, sflag, tflag, vflag;
 int kflag; // kittycat (kc) extensions
+int zflag; // report which copy path raw_cat took per file
 int rval;
 const char *filename;
 const char *kitty;       // path to kitty marker (PID file) that facilitates signalling us
@@ -104,15 +118,50 @@ struct sigaction kitty_catnip_handler; // catnip (or other origin) signals to ha
 struct timespec kitty_catnap_request;    // set .tv_sec or .tv_nsec to requested nap time
 struct timespec kitty_catnap_remainder;  // side effect of nanosleep() for premature wake
 int kitty_catnip_received; 		 // which signal received
+int kitty_catnip_value;			 // what came with it from sigqueue(), else 0
+sigset_t kitty_catnip_set;		 // the signals above, blocked except while we wait for them
+volatile sig_atomic_t kitty_catnip_caught; // times catch_catnip() ran that the waiter has yet to take
+#ifdef __linux__
+struct kitty_ring* kitty_ring;		 // shared with cn through the kitty marker, or NULL
+#endif
+
+/*
+ * read-ahead across the file list: while one file streams out, the next
+ * one in argv is already open and the start of it is on its way into the
+ * page cache, so a cold batch waits on the disk once rather than per file.
+ * only regular files are opened early (a FIFO or socket would block, or
+ * be consumed out of turn), and the early fd is used only if the path
+ * still names the same file when its turn comes: cn rewrites its files
+ * in place between nips, but someone else may rename a new one over it.
+ */
+#define KITTY_PREFETCH (2 * 1024 * 1024) // bytes asked for ahead of the first read
+
+struct kitty_next {
+	int	fd; // or -1
+	const char *path;
+	struct stat st;
+};
 
 static void usage(void);
 static void scanfiles(char *argv[], int cooked);
 static void cook_cat(FILE *);
 static void raw_cat(int);
+static int  raw_cat_kernel(int, int, int, off_t*);
+static int  take_next(struct kitty_next *, const char *);
+static void open_next(struct kitty_next *, const char *);
+static void advise_sequential(int);
+#ifdef __linux__
+static int  ahead_cat(int, int, size_t, off_t *);
+#endif
 static void create_kitty_marker();
 static void parse_timespec( char* wait_time, struct timespec* result );
 static void ready_for_catnip();
 static void wait_for_catnip();
+static void catch_catnip( int signum, siginfo_t* info, void* context );
+static void took_catnip( int signum, int value );
+#ifdef __linux__
+static void wait_for_ring();
+#endif
 
 #ifndef NO_UDOM_SUPPORT
 static int udom_open(const char *path, int flags);
@@ -129,8 +178,7 @@ main(int argc, char *argv[])
 	kitty_catnap_request.tv_nsec = 250000000; // default to quarter second
 
 	ready_for_catnip();    // kittycat catches catnip signals
-	create_kitty_marker(); // kittycat extension for backwash signalling along pipeline
-	while ((ch = getopt(argc, argv, "benstuvk:w:")) != -1)
+	while ((ch = getopt(argc, argv, "benstuvk:w:z")) != -1)
 		switch (ch) {
 		case 'b':
 			bflag = nflag = 1;	/* -b implies -n */
@@ -160,11 +208,15 @@ main(int argc, char *argv[])
 		case 'w':			/* kitty catnap wait time */
 			parse_timespec( optarg, &kitty_catnap_request );
 			break;
+		case 'z':			/* report raw_cat copy path */
+			zflag = 1;
+			break;
 		default:
 			usage();
 		}
 	argv += optind;
 
+	create_kitty_marker(); // kittycat extension for backwash signalling along pipeline, once -k has had its say
 	if (bflag || eflag || nflag || sflag || tflag || vflag)
 		scanfiles(argv, 1);
 	else
@@ -178,7 +230,7 @@ main(int argc, char *argv[])
 static void
 usage(void)
 {
-	fprintf(stderr, "usage: kc [-benstuv] [-k  kitty_rendezvous_file] [-w kitty_catnap_wait_time] [file ...]\n");
+	fprintf(stderr, "usage: kc [-benstuvz] [-k  kitty_rendezvous_file] [-w kitty_catnap_wait_time] [file ...]\n");
 	exit(1);
 	/* NOTREACHED */
 }
@@ -189,6 +241,7 @@ scanfiles(char *argv[], int cooked)
 	int i = 0;
 	char *path;
 	FILE *fp;
+	struct kitty_next next = { .fd = -1 };
 
 	while ((path = argv[i]) != NULL || i == 0) {
 		int fd;
@@ -199,12 +252,17 @@ scanfiles(char *argv[], int cooked)
 			fd = STDIN_FILENO;
 		} else {
 			filename = path;
-			fd = open(path, O_RDONLY);
+			if ((fd = take_next(&next, path)) < 0)
+				fd = open(path, O_RDONLY);
 #ifndef NO_UDOM_SUPPORT
 			if (fd < 0 && errno == EOPNOTSUPP)
 				fd = udom_open(path, O_RDONLY);
 #endif
 		}
+		if (fd >= 0 && path != NULL) {
+			advise_sequential(fd);
+			open_next(&next, argv[i + 1]); // while this one streams
+		}
 		if (fd < 0) {
 			warn("%s", path);
 			rval = 1;
@@ -225,69 +283,286 @@ scanfiles(char *argv[], int cooked)
 			break;
 		++i;
 	}
+	if (next.fd >= 0)
+		close(next.fd);
+}
+
+// take_next: the fd open_next() opened early for path, if it is still the file there
+static int
+take_next(struct kitty_next *next, const char *path)
+{
+	struct stat st;
+	int fd = next->fd;
+
+	if (fd < 0)
+		return -1;
+	next->fd = -1;
+	if (next->path == path && stat(path, &st) == 0 &&
+	    st.st_dev == next->st.st_dev && st.st_ino == next->st.st_ino)
+		return fd;
+	close(fd);
+	return -1;
+}
+
+static void
+open_next(struct kitty_next *next, const char *path)
+{
+	int fd;
+
+	if (next->fd >= 0 || path == NULL || strcmp(path, "-") == 0)
+		return;
+	if ((fd = open(path, O_RDONLY|O_NONBLOCK)) < 0)
+		return; // not there yet, it gets opened in its turn
+	if (fstat(fd, &next->st) < 0 || !S_ISREG(next->st.st_mode)) {
+		close(fd);
+		return;
+	}
+	fcntl(fd, F_SETFL, 0); // as open() in scanfiles() would have left it
+	advise_sequential(fd);
+	next->fd = fd;
+	next->path = path;
+}
+
+// advise_sequential tells the kernel we read fd front to back, starting now
+static void
+advise_sequential(int fd)
+{
+#ifdef POSIX_FADV_SEQUENTIAL
+	(void)posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL); // doubles the read-ahead window
+	(void)posix_fadvise(fd, 0, KITTY_PREFETCH, POSIX_FADV_WILLNEED);
+#endif
+}
+
+/*
+ * cook_cat applies -b -e -n -s -t -v a block at a time, where cat went
+ * through getc() and putchar() per byte and fprintf() per line number.
+ * cook_table() runs cat's per-byte logic once for each of the 256 byte
+ * values, in the locale we were started in, so what a byte turns into is
+ * exactly what cat printed for it. the block loop only stops at bytes that
+ * need more than copying: newlines when a line-start flag or -e cares, and
+ * whatever -t or -v rewrite. the runs in between go out in one piece,
+ * found with memchr() or, for -v, sixteen bytes at a time with SSE2.
+ * line numbers count up in place as text.
+ */
+#define KITTY_COOK_BSIZE (128 * 1024)
+
+struct kitty_cook {
+	unsigned char stop[256]; // byte needs more than copying
+	char	expand[256][5]; // what -t or -v make of a stop byte other than newline
+	unsigned char starts[256]; // cat's prev ends up '\n' after it, so a line starts (M-^J)
+	int	coarse; // every stop is below 0x20, 0x7f or above: SSE2 may prefilter
+};
+
+// a line number as "%6d\t" would print it, incremented in place
+struct kitty_lineno {
+	char	digits[24]; // right aligned, spaces in front
+	int	first; // the leading digit
+};
+
+static void
+cook_table(struct kitty_cook *k)
+{
+	for (int c = 0; c < 256; ++c) {
+		char *e = k->expand[c];
+		int ch = c;
+
+		k->stop[c] = k->starts[c] = 0;
+		if (c == '\n') {
+			k->stop[c] = eflag || nflag || sflag;
+			continue;
+		}
+		if (c == '\t') {
+			if (tflag) {
+				strcpy(e, "^I");
+				k->stop[c] = 1;
+			}
+			continue;
+		}
+		if (!vflag)
+			continue;
+		if (!isascii(ch) && !isprint(ch)) {
+			*e++ = 'M';
+			*e++ = '-';
+			ch = toascii(ch);
+		}
+		if (iscntrl(ch)) {
+			*e++ = '^';
+			*e++ = ch == '\177' ? '?' : ch | 0100;
+		} else
+			*e++ = ch;
+		*e = '\0';
+		k->starts[c] = ch == '\n';
+		k->stop[c] = e - k->expand[c] != 1 || (unsigned char)k->expand[c][0] != c;
+	}
+	k->coarse = 1;
+	for (int c = 0x20; c < 0x7f; ++c)
+		if (k->stop[c])
+			k->coarse = 0;
+}
+
+// cook_scan finds the first stop byte in [p, end), or end
+static const unsigned char *
+cook_scan(const struct kitty_cook *k, const unsigned char *p, const unsigned char *end)
+{
+	const unsigned char *q;
+
+	if (!vflag) // newline is the only byte that can stop
+		return k->stop['\n'] && (q = memchr(p, '\n', end - p)) != NULL ? q : end;
+#ifdef __SSE2__
+	if (k->coarse) {
+		const __m128i space = _mm_set1_epi8(0x20), del = _mm_set1_epi8(0x7f);
+		for (; end - p >= 16; p += 16) {
+			__m128i v = _mm_loadu_si128((const __m128i *)p);
+			// signed compare: below space takes 0x80 and up along with the controls
+			unsigned m = _mm_movemask_epi8(_mm_or_si128(_mm_cmplt_epi8(v, space), _mm_cmpeq_epi8(v, del)));
+			for (; m != 0; m &= m - 1)
+				if (k->stop[p[__builtin_ctz(m)]])
+					return p + __builtin_ctz(m);
+		}
+	}
+#endif
+	while (p < end && !k->stop[*p])
+		++p;
+	return p;
+}
+
+static size_t
+cook_lineno(struct kitty_lineno *num, char *out)
+{
+	int i, from, last = sizeof(num->digits) - 1;
+
+	for (i = last; num->digits[i] == '9'; --i)
+		num->digits[i] = '0';
+	if (num->digits[i] == ' ') {
+		num->digits[i] = '1';
+		num->first = i;
+	} else
+		++num->digits[i];
+	from = MIN(num->first, last + 1 - 6);
+	memcpy(out, num->digits + from, last + 1 - from);
+	out[last + 1 - from] = '\t';
+	return last + 2 - from;
+}
+
+static void
+cook_flush(const char *out, size_t len)
+{
+	if (len > 0 && fwrite(out, 1, len, stdout) != len)
+		err(1, "stdout");
 }
 
 static void
 cook_cat(FILE *fp)
 {
-	int ch, gobble, line, prev;
+	static struct kitty_cook k;
+	static unsigned char *in;
+	static char *out;
+	static size_t cap;
+	const unsigned char *p, *q, *end;
+	struct kitty_lineno num;
+	int fd = fileno(fp), gobble = 0, start = 1; // start: at the start of a line
+	size_t o = 0, run;
+	ssize_t n;
 
 	/* Reset EOF condition on stdin. */
 	if (fp == stdin && feof(stdin))
 		clearerr(stdin);
 
-	line = gobble = 0;
-	for (prev = '\n'; (ch = getc(fp)) != EOF; prev = ch) {
-		if (prev == '\n') {
-			if (sflag) {
-				if (ch == '\n') {
-					if (gobble)
-						continue;
-					gobble = 1;
-				} else
-					gobble = 0;
-			}
-			if (nflag && (!bflag || ch != '\n')) {
-				(void)fprintf(stdout, "%6d\t", ++line);
-				if (ferror(stdout))
-					break;
-			}
-		}
-		if (ch == '\n') {
-			if (eflag && putchar('$') == EOF)
-				break;
-		} else if (ch == '\t') {
-			if (tflag) {
-				if (putchar('^') == EOF || putchar('I') == EOF)
-					break;
+	if (in == NULL) {
+		cook_table(&k); // the flags and the locale are settled by now
+		cap = 2 * KITTY_COOK_BSIZE;
+		if ((in = malloc(KITTY_COOK_BSIZE)) == NULL || (out = malloc(cap)) == NULL)
+			err(1, "buffer");
+	}
+	memset(num.digits, ' ', sizeof(num.digits));
+	num.first = sizeof(num.digits) - 1;
+	num.digits[num.first] = '0';
+	while ((n = read(fd, in, KITTY_COOK_BSIZE)) != 0) {
+		if (n < 0) {
+			if (errno == EINTR)
 				continue;
+			warn("%s", filename);
+			rval = 1;
+			break;
+		}
+		for (p = in, end = in + n; p < end; ) {
+			if (start) {
+				if (sflag) {
+					if (*p == '\n') {
+						if (gobble) {
+							++p;
+							continue;
+						}
+						gobble = 1;
+					} else
+						gobble = 0;
+				}
+				if (nflag && (!bflag || *p != '\n'))
+					o += cook_lineno(&num, out + o);
+				start = 0;
 			}
-		} else if (vflag) {
-			if (!isascii(ch) && !isprint(ch)) {
-				if (putchar('M') == EOF || putchar('-') == EOF)
-					break;
-				ch = toascii(ch);
+			q = cook_scan(&k, p, end);
+			if (o + (run = q - p) + 64 > cap) { // room for a run, plus a stop byte and a line number after it
+				cook_flush(out, o);
+				o = 0;
+				if (run > cap - 64) {
+					cook_flush((const char *)p, run);
+					run = 0;
+				}
 			}
-			if (iscntrl(ch)) {
-				if (putchar('^') == EOF ||
-				    putchar(ch == '\177' ? '?' :
-				    ch | 0100) == EOF)
-					break;
-				continue;
+			memcpy(out + o, p, run);
+			o += run;
+			if ((p = q) == end)
+				break;
+			if (*p == '\n') {
+				if (eflag)
+					out[o++] = '$';
+				out[o++] = '\n';
+				start = 1;
+			} else {
+				for (const char *e = k.expand[*p]; *e; ++e)
+					out[o++] = *e;
+				start = k.starts[*p];
 			}
+			++p;
 		}
-		if (putchar(ch) == EOF)
-			break;
+		cook_flush(out, o); // each block as it comes, for -u and for a terminal
+		o = 0;
 	}
-	if (ferror(fp)) {
-		warn("%s", filename);
-		rval = 1;
-		clearerr(fp);
-	}
-	if (ferror(stdout))
+	if (fflush(stdout) == EOF || ferror(stdout))
 		err(1, "stdout");
 }
 
+/*
+ * raw_cat picks the cheapest copy path for each (source, sink) pair:
+ *	pipe on either end	--> splice(2)
+ *	file --> socket		--> sendfile(2)
+ *	file --> file		--> copy_file_range(2)
+ *	anything else		--> read(2)/write(2) through a large buffer
+ * a kernel path that refuses the pair (EINVAL, ENOSYS, EXDEV, ...) before moving
+ * any bytes hands over to the next candidate, and ultimately to the buffer loop,
+ * which picks up from the current offset of rfd.
+ * with -z we report to stderr how many bytes went through which path, so a large
+ * body can be checked for never having passed through userspace.
+ */
+enum kitty_copy_path {
+	KITTY_COPY_SPLICE,
+	KITTY_COPY_SENDFILE,
+	KITTY_COPY_FILE_RANGE,
+	KITTY_COPY_READ_WRITE,
+	KITTY_COPY_PATHS
+};
+
+static const char *kitty_copy_names[KITTY_COPY_PATHS] = {
+	"splice",
+	"sendfile",
+	"copy_file_range",
+	"read/write"
+};
+
+#define KITTY_RAW_BSIZE (128 * 1024) // fallback buffer; st_blksize is only 4 KiB on a pipe
+#define KITTY_KERNEL_CHUNK (1 << 30) // per-call request for the kernel paths
+
 static void
 raw_cat(int rfd)
 {
@@ -295,24 +570,207 @@ raw_cat(int rfd)
 	ssize_t nr, nw;
 	static size_t bsize;
 	static char *buf = NULL;
-	struct stat sbuf;
+	struct stat rsbuf, wsbuf;
+	off_t moved[KITTY_COPY_PATHS];
+	int path, candidates[KITTY_COPY_PATHS], ncandidates = 0;
+	int finished = KITTY_COPY_READ_WRITE;
 
 	wfd = fileno(stdout);
+	memset(moved, 0, sizeof(moved));
+	if (fstat(wfd, &wsbuf))
+		err(1, "%s", filename);
+	if (fstat(rfd, &rsbuf))
+		err(1, "%s", filename);
+#ifdef __linux__
+	if (S_ISFIFO(rsbuf.st_mode) || S_ISFIFO(wsbuf.st_mode))
+		candidates[ncandidates++] = KITTY_COPY_SPLICE;
+	if (S_ISREG(rsbuf.st_mode) && S_ISSOCK(wsbuf.st_mode))
+		candidates[ncandidates++] = KITTY_COPY_SENDFILE;
+	if (S_ISREG(rsbuf.st_mode) && S_ISREG(wsbuf.st_mode))
+		candidates[ncandidates++] = KITTY_COPY_FILE_RANGE;
+#endif
+	for (int i = 0; i < ncandidates; ++i) {
+		path = candidates[i];
+		if (raw_cat_kernel(path, rfd, wfd, &moved[path]) == 0) {
+			finished = path;
+			goto report; // done, through the kernel all the way
+		}
+		if (moved[path] > 0 || (errno != EINVAL && errno != ENOSYS &&
+		    errno != EXDEV && errno != EOPNOTSUPP && errno != EBADF))
+			break; // a real error, or a partial copy we let the loop finish
+	}
+
 	if (buf == NULL) {
-		if (fstat(wfd, &sbuf))
-			err(1, "%s", filename);
-		bsize = MAX(sbuf.st_blksize, 1024);
+		bsize = MAX(wsbuf.st_blksize, KITTY_RAW_BSIZE);
 		if ((buf = malloc(bsize)) == NULL)
 			err(1, "buffer");
 	}
-	while ((nr = read(rfd, buf, bsize)) > 0)
+#ifdef __linux__
+	// more than a buffer of file left: read the next while this one is written
+	if (S_ISREG(rsbuf.st_mode) && rsbuf.st_size - lseek(rfd, 0, SEEK_CUR) > (off_t)bsize) {
+		switch (ahead_cat(rfd, wfd, bsize, &moved[KITTY_COPY_READ_WRITE])) {
+		case 0:
+			goto report;
+		case -1:
+			warn("%s", filename);
+			rval = 1;
+			goto report;
+		default:
+			break; // no thread, do it the old way
+		}
+	}
+#endif
+	while ((nr = read(rfd, buf, bsize)) > 0) {
+		moved[KITTY_COPY_READ_WRITE] += nr;
 		for (off = 0; nr; nr -= nw, off += nw)
 			if ((nw = write(wfd, buf + off, (size_t)nr)) < 0)
 				err(1, "stdout");
+	}
 	if (nr < 0) {
 		warn("%s", filename);
 		rval = 1;
 	}
+report:
+	if (zflag) {
+		fprintf(stderr, "kittycat: %s: finished by %s;", filename, kitty_copy_names[finished]);
+		for (path = 0; path < KITTY_COPY_PATHS; ++path)
+			if (moved[path] || path == finished)
+				fprintf(stderr, " %s %lld bytes", kitty_copy_names[path], (long long)moved[path]);
+		fprintf(stderr, "\n");
+	}
+}
+
+#ifdef __linux__
+/*
+ * ahead_cat is the read/write loop with its reads overlapped: a reader
+ * thread fills a ring of KITTY_AHEAD_SLOTS buffers ahead of the writes.
+ * head is only stored by the reader and tail only by the writer, so the
+ * ring needs no lock; a side that finds it full (or empty) sleeps on the
+ * other's word with futex(2), as kc does on the kitty ring.
+ * returns 0 at end of input, -1 with errno set after a failed read, and
+ * 1 when there is no thread to be had.
+ */
+#define KITTY_AHEAD_SLOTS 4
+
+struct kitty_ahead {
+	uint32_t head; // slots filled by the reader
+	uint32_t tail; // slots emptied by the writer
+	int	rfd;
+	int	error; // errno of the read that ended it, or 0
+	size_t	bsize;
+	ssize_t	len[KITTY_AHEAD_SLOTS]; // 0 at end of input, -1 on error
+	char	*buf[KITTY_AHEAD_SLOTS];
+};
+
+static void *
+ahead_reader(void *arg)
+{
+	struct kitty_ahead *a = arg;
+	uint32_t head = a->head, tail;
+	ssize_t n;
+
+	do {
+		while (head - (tail = __atomic_load_n(&a->tail, __ATOMIC_ACQUIRE)) == KITTY_AHEAD_SLOTS)
+			syscall(SYS_futex, &a->tail, FUTEX_WAIT, tail, NULL, NULL, 0);
+		while ((n = read(a->rfd, a->buf[head % KITTY_AHEAD_SLOTS], a->bsize)) < 0 && errno == EINTR)
+			;
+		if (n < 0)
+			a->error = errno;
+		a->len[head % KITTY_AHEAD_SLOTS] = n;
+		__atomic_store_n(&a->head, ++head, __ATOMIC_RELEASE);
+		syscall(SYS_futex, &a->head, FUTEX_WAKE, 1, NULL, NULL, 0);
+	} while (n > 0);
+	return NULL;
+}
+
+static int
+ahead_cat(int rfd, int wfd, size_t bsize, off_t *moved)
+{
+	static struct kitty_ahead a;
+	pthread_t reader;
+	sigset_t all, old;
+	uint32_t head, tail;
+	ssize_t n, nw;
+	int e;
+
+	if (a.bsize != bsize) {
+		for (int i = 0; i < KITTY_AHEAD_SLOTS; ++i) {
+			free(a.buf[i]);
+			if ((a.buf[i] = malloc(bsize)) == NULL)
+				err(1, "buffer");
+		}
+		a.bsize = bsize;
+	}
+	a.head = a.tail = 0;
+	a.rfd = rfd;
+	a.error = 0;
+	sigfillset(&all); // catnip signals stay with the main thread
+	pthread_sigmask(SIG_BLOCK, &all, &old);
+	e = pthread_create(&reader, NULL, ahead_reader, &a);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	if (e != 0)
+		return 1;
+	for (tail = 0;; ) {
+		while ((head = __atomic_load_n(&a.head, __ATOMIC_ACQUIRE)) == tail)
+			syscall(SYS_futex, &a.head, FUTEX_WAIT, head, NULL, NULL, 0);
+		n = a.len[tail % KITTY_AHEAD_SLOTS];
+		for (ssize_t off = 0; off < n; off += nw)
+			if ((nw = write(wfd, a.buf[tail % KITTY_AHEAD_SLOTS] + off, (size_t)(n - off))) < 0)
+				err(1, "stdout");
+		if (n > 0)
+			*moved += n;
+		__atomic_store_n(&a.tail, ++tail, __ATOMIC_RELEASE);
+		syscall(SYS_futex, &a.tail, FUTEX_WAKE, 1, NULL, NULL, 0);
+		if (n <= 0)
+			break;
+	}
+	pthread_join(reader, NULL);
+	if (n < 0) {
+		errno = a.error;
+		return -1;
+	}
+	return 0;
+}
+#endif
+
+/*
+ * raw_cat_kernel moves everything left in rfd to wfd along one kernel path,
+ * counting into *moved. returns 0 at end of input, -1 with errno set otherwise.
+ */
+static int
+raw_cat_kernel(int path, int rfd, int wfd, off_t *moved)
+{
+#ifdef __linux__
+	ssize_t n;
+
+	for (;;) {
+		switch (path) {
+		case KITTY_COPY_SPLICE:
+			n = splice(rfd, NULL, wfd, NULL, KITTY_KERNEL_CHUNK, SPLICE_F_MOVE|SPLICE_F_MORE);
+			break;
+		case KITTY_COPY_SENDFILE:
+			n = sendfile(wfd, rfd, NULL, KITTY_KERNEL_CHUNK);
+			break;
+		case KITTY_COPY_FILE_RANGE:
+			n = copy_file_range(rfd, NULL, wfd, NULL, KITTY_KERNEL_CHUNK, 0);
+			break;
+		default:
+			errno = EINVAL;
+			return -1;
+		}
+		if (n == 0)
+			return 0;
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		*moved += n;
+	}
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
 }
 
 #ifndef NO_UDOM_SUPPORT
@@ -393,6 +851,23 @@ create_kitty_marker()
 			dprintf( fd, "%d\n", getpid() );
 			close( fd );
 		}
+#ifdef __linux__
+		// and next to it, the ring cn nips us through (see kitty-ring.h)
+		char ring[PATH_MAX];
+		void* p;
+		snprintf( ring, sizeof( ring ), "%s%s", kitty, KITTY_RING_SUFFIX );
+		fd = open(ring, O_RDWR|O_CREAT|O_TRUNC, 0600); // truncated, so any old records are gone
+		if( fd < 0
+		 || ftruncate( fd, sizeof( struct kitty_ring ) ) < 0
+		 || ( p = mmap( NULL, sizeof( struct kitty_ring ), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0 ) ) == MAP_FAILED )
+			warn("%s, cn will have to signal", ring);
+		else{
+			kitty_ring = p;
+			__atomic_store_n( &kitty_ring->magic, KITTY_RING_MAGIC, __ATOMIC_RELEASE );
+		}
+		if( fd >= 0 )
+			close( fd );
+#endif
 	}
 }
 
@@ -410,6 +885,8 @@ parse_timespec( char* wait_time, struct timespec* result )
  * this could be used with the catnip(1) command or any other kill(2) or signal initiator,
  * or just time delay.
  * implement with sigsuspend() or nanosleep() according to particular criteria needed.
+ * on Linux the nap is only a timeout: we take the ring's next record (wait_for_ring),
+ * or the next of our blocked signals with sigtimedwait(), the moment there is one.
  * 
  * should be passed context, but in keeping with the cat(1) we're incorporating into,
  * we instead use dependencies (ick) on global variables (joy).
@@ -425,8 +902,25 @@ wait_for_catnip()
 	int result;
 	switch( kitty_catnip_received ){
 	case 0:       // we have received nothing, first time waiting
-	default:      // default to Continue style
+	default:      // default to Continue style, which includes the queued KITTY_NIP_SIGNAL
 	case SIGCONT: // continue to next file in list
+#ifdef __linux__
+		if( kitty_ring != NULL ){
+			wait_for_ring();
+			break;
+		}
+		// the signals are blocked, so one sent while we were catting is
+		// still pending here rather than lost before we get to sleep
+		siginfo_t info;
+		do
+			result = sigtimedwait( &kitty_catnip_set, &info, &kitty_catnap_request );
+		while( result < 0 && errno == EINTR );
+		if( result < 0 )
+			fprintf( stderr, "kittycat: napped %ld s, %ld ns without a nip\n", kitty_catnap_request.tv_sec, kitty_catnap_request.tv_nsec );
+		else
+			took_catnip( result, info.si_code == SI_QUEUE ? info.si_value.sival_int : 0 );
+		break;
+#endif
 		fprintf( stderr, "kittycat: napping %ld s, %ld ns\n", kitty_catnap_request.tv_sec, kitty_catnap_request.tv_nsec );
 		result = nanosleep( &kitty_catnap_request, &kitty_catnap_remainder );
 		fprintf( stderr, "kittycat: awake result %d, errno %d, remaining %ld s, %ld ns\n", result, errno, kitty_catnap_remainder.tv_sec, kitty_catnap_remainder.tv_nsec );
@@ -437,13 +931,78 @@ wait_for_catnip()
 	}
 }
 
+#ifdef __linux__
+/*
+ * wait_for_ring takes the next "ready" record cn left in the ring, sleeping
+ * on the futex for it when there is none yet. the nap is only the timeout
+ * now; a signal from an older cn or kill(1) ends the wait as it always did.
+ */
 static void
-catch_catnip( int signum ){
+wait_for_ring()
+{
+	static const struct timespec now = { 0, 0 };
+	struct kitty_ready ready;
+	siginfo_t info;
+	uint32_t seen;
+	long result;
+	int e;
+
+	for( ;; ){
+		seen = __atomic_load_n( &kitty_ring->futex, __ATOMIC_ACQUIRE );
+		if( kitty_ring_pop( kitty_ring, &ready ) == 0 ){
+			fprintf( stderr, "kittycat: nipped for %s, %lld bytes (#%llu)\n", ready.name, (long long)ready.size, (unsigned long long)ready.seq );
+			return;
+		}
+		if( ( e = sigtimedwait( &kitty_catnip_set, &info, &now ) ) > 0 ){ // one already waiting
+			took_catnip( e, info.si_code == SI_QUEUE ? info.si_value.sival_int : 0 );
+			return;
+		}
+		// a signal lets us out of the futex too; catch_catnip() bumps the futex
+		// word, so one landing before we are asleep does not leave us asleep
+		// more than one can come in while they are unblocked, each counts for a file
+		if( kitty_catnip_caught == 0 ){
+			sigprocmask( SIG_UNBLOCK, &kitty_catnip_set, NULL );
+			result = kitty_ring_wait( kitty_ring, seen, &kitty_catnap_request );
+			e = errno;
+			sigprocmask( SIG_BLOCK, &kitty_catnip_set, NULL );
+		}
+		if( kitty_catnip_caught > 0 ){
+			--kitty_catnip_caught;
+			took_catnip( kitty_catnip_received, kitty_catnip_value );
+			return;
+		}
+		if( result < 0 && e == ETIMEDOUT ){
+			fprintf( stderr, "kittycat: napped %ld s, %ld ns without a nip\n", kitty_catnap_request.tv_sec, kitty_catnap_request.tv_nsec );
+			return;
+		}
+	}
+}
+#endif
+
+static void
+catch_catnip( int signum, siginfo_t* info, void* context ){
+	(void)context;
 	kitty_catnip_received = signum; // remembers only most recent signal caught
-	fprintf( stderr, "kittycat caught %d\n", signum );
+	kitty_catnip_value = info != NULL && info->si_code == SI_QUEUE ? info->si_value.sival_int : 0;
+	++kitty_catnip_caught;
+#ifdef __linux__
+	if( kitty_ring != NULL )
+		__atomic_add_fetch( &kitty_ring->futex, 1, __ATOMIC_RELEASE );
+#endif
 	return; // back to neverland
 }
 
+// took_catnip notes a signal the waiter has taken, from the handler or sigtimedwait()
+static void
+took_catnip( int signum, int value ){
+	kitty_catnip_received = signum;
+	kitty_catnip_value = value;
+	if( value )
+		fprintf( stderr, "kittycat caught %d, nip #%d\n", signum, value );
+	else
+		fprintf( stderr, "kittycat caught %d\n", signum );
+}
+
 
 /*
  * kittycat catches catnip signals
@@ -452,10 +1011,21 @@ catch_catnip( int signum ){
 static void
 ready_for_catnip(){
 	kitty_catnip_received = 0; // have not yet received any signals
-	kitty_catnip_handler.sa_handler = catch_catnip;
-	kitty_catnip_handler.sa_flags = 0;
+	kitty_catnip_handler.sa_sigaction = catch_catnip;
+	kitty_catnip_handler.sa_flags = SA_SIGINFO;
+	sigemptyset( &kitty_catnip_handler.sa_mask );
 	sigaction( SIGHUP, &kitty_catnip_handler, NULL );
 	sigaction( SIGTERM, &kitty_catnip_handler, NULL );
 	sigaction( SIGCONT, &kitty_catnip_handler, NULL );
+#ifdef __linux__
+	// held until wait_for_catnip() asks for them, none get lost in between
+	sigemptyset( &kitty_catnip_set );
+	sigaddset( &kitty_catnip_set, SIGHUP );
+	sigaddset( &kitty_catnip_set, SIGTERM );
+	sigaddset( &kitty_catnip_set, SIGCONT );
+	sigaddset( &kitty_catnip_set, KITTY_NIP_SIGNAL );
+	sigaction( KITTY_NIP_SIGNAL, &kitty_catnip_handler, NULL );
+	sigprocmask( SIG_BLOCK, &kitty_catnip_set, NULL );
+#endif
 }
 